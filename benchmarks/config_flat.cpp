@@ -0,0 +1,111 @@
+// -*- C++ -*-
+// Copyright (C) Dmitry Igrishin
+// For conditions of distribution and use, see files LICENSE.txt or internal.hpp
+
+#include <dmitigr/internal/config.hpp>
+#include <dmitigr/internal/filesystem.hpp>
+#include <dmitigr/internal/string.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <locale>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace config = dmitigr::internal::config;
+namespace fs = dmitigr::internal::filesystem;
+namespace str = dmitigr::internal::string;
+
+namespace {
+
+template<typename F>
+double measure(F&& f)
+{
+  const auto start = std::chrono::steady_clock::now();
+  f();
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+/// The line-based parser (one string per line, std::map) as the baseline.
+std::map<std::string, std::string> parse_by_lines(const std::filesystem::path& path)
+{
+  std::map<std::string, std::string> result;
+  const auto lines = fs::read_lines_to_vector_if(path, [](const std::string& line)
+  {
+    const auto pos = str::position_of_non_space(line, 0);
+    return pos < line.size() && line[pos] != '#';
+  });
+  for (const auto& line : lines) {
+    std::string param, value;
+    auto pos = str::position_of_non_space(line, 0);
+    std::tie(param, pos) = str::substring_if_simple_identifier(line, pos);
+    if (param.empty() || pos == line.size())
+      throw std::runtime_error{"invalid parameter name"};
+    pos = str::position_of_non_space(line, pos);
+    if (pos == line.size() || line[pos] != '=')
+      throw std::runtime_error{"no value assignment"};
+    if (pos = str::position_of_non_space(line, pos + 1); pos < line.size())
+      std::tie(value, pos) = str::unquoted_substring(line, pos);
+    result.insert({std::move(param), std::move(value)});
+  }
+  return result;
+}
+
+} // namespace
+
+/*
+ * Usage: dmitigr_internal_benchmark_config_flat [directory [entry_count [lookup_count]]]
+ */
+int main(const int argc, const char* const argv[])
+{
+  const std::filesystem::path dir{argc > 1 ? argv[1] : "."};
+  const std::size_t entry_count = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100000;
+  const std::size_t lookup_count = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 10000000;
+  const auto path = dir / "dmitigr_internal_benchmark_config_flat.conf";
+
+  std::vector<std::string> names;
+  {
+    std::ofstream output{path};
+    for (std::size_t i = 0; i < entry_count; ++i) {
+      names.push_back("parameter_" + std::to_string(i * 7919 % entry_count));
+      if (i % 10 == 0)
+        output << "# Comment " << i << "\n\n";
+      output << names.back();
+      switch (i % 3) {
+      case 0: output << " = " << i << "\n"; break;
+      case 1: output << " = 'value with spaces " << i << "'\n"; break;
+      case 2: output << "='value with \\'escaped\\' quotes " << i << "'\n"; break;
+      }
+    }
+  }
+  std::printf("%zu entries, %zu lookups\n", entry_count, lookup_count);
+
+  std::map<std::string, std::string> map;
+  std::printf("%-32s %8.3f s\n", "parse (lines, std::map)",
+    measure([&]{ map = parse_by_lines(path); }));
+  std::printf("%-32s %8.3f s\n", "parse (config::Flat)",
+    measure([&]{ config::Flat{path}; }));
+
+  const config::Flat flat{path};
+  std::size_t found{};
+  std::printf("%-32s %8.3f s\n", "lookup (std::map, std::string)", measure([&]
+  {
+    for (std::size_t i = 0; i < lookup_count; ++i)
+      found += map.find(names[i % names.size()]) != map.end();
+  }));
+  std::printf("%-32s %8.3f s\n", "lookup (config::Flat)", measure([&]
+  {
+    for (std::size_t i = 0; i < lookup_count; ++i)
+      found += flat.string_parameter(names[i % names.size()]).has_value();
+  }));
+  if (found != 2 * lookup_count)
+    std::printf("unexpected number of found parameters: %zu\n", found);
+
+  std::filesystem::remove(path);
+}
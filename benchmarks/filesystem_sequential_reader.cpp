@@ -0,0 +1,115 @@
+// -*- C++ -*-
+// Copyright (C) Dmitry Igrishin
+// For conditions of distribution and use, see files LICENSE.txt or internal.hpp
+
+#include <dmitigr/internal/filesystem.hpp>
+#include <dmitigr/internal/os.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace fs = dmitigr::internal::filesystem;
+namespace os = dmitigr::internal::os;
+
+namespace {
+
+/// @returns The percentage of the pages of the file at `path` which are in the page cache.
+double cached_percentage(const std::filesystem::path& path, const std::uintmax_t size)
+{
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  void* const data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return -1;
+  const auto page_size = os::page_size();
+  std::vector<unsigned char> pages((size + page_size - 1) / page_size);
+  std::size_t cached{};
+  if (!::mincore(data, size, pages.data())) {
+    for (const auto page : pages)
+      cached += page & 1;
+  }
+  ::munmap(data, size);
+  return 100.0 * double(cached) / double(pages.size());
+}
+
+/// Evicts the (clean) pages of the file at `path` from the page cache.
+void evict(const std::filesystem::path& path)
+{
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  ::close(fd);
+}
+
+template<typename F>
+void measure(const char* const name, const std::filesystem::path& path,
+  const std::uintmax_t size, F&& f)
+{
+  evict(path);
+  const auto start = std::chrono::steady_clock::now();
+  const std::uintmax_t read = f();
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  if (read != size)
+    std::printf("%-32s read %ju of %ju bytes!\n", name, read, size);
+  std::printf("%-32s %8.3f s %10.1f MiB/s %7.1f%% cached\n", name, elapsed.count(),
+    double(size) / (1024 * 1024) / elapsed.count(), cached_percentage(path, size));
+}
+
+} // namespace
+
+/*
+ * Usage: dmitigr_internal_benchmark_filesystem_sequential_reader [directory [size_in_mib]]
+ */
+int main(const int argc, const char* const argv[])
+{
+  const std::filesystem::path dir{argc > 1 ? argv[1] : "."};
+  const std::uintmax_t size = (argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 512) * 1024 * 1024;
+  const auto path = dir / "dmitigr_internal_benchmark_filesystem_sequential_reader.dat";
+
+  {
+    fs::File_writer output{path};
+    const std::string block(1024 * 1024, 'x');
+    for (std::uintmax_t written{}; written < size; written += block.size())
+      output.write(block.data(), std::min<std::uintmax_t>(block.size(), size - written));
+    output.commit();
+  }
+  std::printf("reading %ju MiB\n", size / (1024 * 1024));
+
+  measure("os::io::read", path, size, [&]
+  {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    std::vector<char> buffer(1024 * 1024);
+    std::uintmax_t result{};
+    while (const auto n = os::io::read(fd, buffer.data(), static_cast<unsigned>(buffer.size())))
+      result += n;
+    ::close(fd);
+    return result;
+  });
+
+  measure("Sequential_reader (direct)", path, size, [&]
+  {
+    fs::Sequential_reader input{path};
+    if (!input.is_direct())
+      std::printf("(direct I/O is unavailable)\n");
+    while (!input.read().empty());
+    return input.offset();
+  });
+
+  measure("Sequential_reader (fadvise)", path, size, [&]
+  {
+    fs::Sequential_reader::Options options;
+    options.is_direct = false;
+    fs::Sequential_reader input{path, options};
+    while (!input.read().empty());
+    return input.offset();
+  });
+
+  std::filesystem::remove(path);
+}
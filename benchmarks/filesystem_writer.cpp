@@ -0,0 +1,79 @@
+// -*- C++ -*-
+// Copyright (C) Dmitry Igrishin
+// For conditions of distribution and use, see files LICENSE.txt or internal.hpp
+
+#include <dmitigr/internal/filesystem.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+namespace fs = dmitigr::internal::filesystem;
+
+namespace {
+
+template<typename F>
+void measure(const char* const name, const std::uintmax_t size, F&& f)
+{
+  const auto start = std::chrono::steady_clock::now();
+  f();
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  std::printf("%-32s %8.3f s %10.1f MiB/s\n", name, elapsed.count(), double(size) / (1024 * 1024) / elapsed.count());
+}
+
+} // namespace
+
+/*
+ * Usage: dmitigr_internal_benchmark_filesystem_writer [directory [size_in_mib [record_size]]]
+ */
+int main(const int argc, const char* const argv[])
+{
+  const std::filesystem::path dir{argc > 1 ? argv[1] : "."};
+  const std::uintmax_t size = (argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 512) * 1024 * 1024;
+  const std::size_t record_size = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 100;
+  const std::string record(record_size, 'x');
+  const auto record_count = size / record_size;
+  const auto path = dir / "dmitigr_internal_benchmark_filesystem_writer.dat";
+
+  std::printf("writing %ju records of %zu bytes\n", record_count, record_size);
+
+  measure("std::ofstream", size, [&]
+  {
+    std::ofstream output{path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc};
+    for (std::uintmax_t i = 0; i < record_count; ++i)
+      output.write(record.data(), static_cast<std::streamsize>(record.size()));
+    output.close();
+  });
+
+  measure("File_writer", size, [&]
+  {
+    fs::File_writer output{path};
+    for (std::uintmax_t i = 0; i < record_count; ++i)
+      output.write(record);
+    output.flush();
+  });
+
+  measure("File_writer (preallocated)", size, [&]
+  {
+    fs::File_writer::Options options;
+    options.expected_size = record_count * record_size;
+    fs::File_writer output{path, options};
+    for (std::uintmax_t i = 0; i < record_count; ++i)
+      output.write(record);
+    output.flush();
+  });
+
+  measure("File_writer (atomic, fsync)", size, [&]
+  {
+    fs::File_writer::Options options;
+    options.is_atomic = true;
+    fs::File_writer output{path, options};
+    for (std::uintmax_t i = 0; i < record_count; ++i)
+      output.write(record);
+    output.commit();
+  });
+
+  std::filesystem::remove(path);
+}
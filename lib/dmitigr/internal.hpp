@@ -25,6 +25,7 @@
 
 #include "dmitigr/internal/algorithm.hpp"
 #include "dmitigr/internal/basics.hpp"
+#include "dmitigr/internal/concurrency.hpp"
 #include "dmitigr/internal/config.hpp"
 #include "dmitigr/internal/console.hpp"
 #include "dmitigr/internal/debug.hpp"
@@ -33,6 +34,7 @@
 #ifdef DMITIGR_INTERNAL_GRAPHICSMAGICK
 #include "dmitigr/internal/graphicsmagick.hpp"
 #endif
+#include "dmitigr/internal/hash.hpp"
 #include "dmitigr/internal/macros.hpp"
 #include "dmitigr/internal/math.hpp"
 #include "dmitigr/internal/memory.hpp"
@@ -0,0 +1,93 @@
+// -*- C++ -*-
+// Copyright (C) Dmitry Igrishin
+// For conditions of distribution and use, see files LICENSE.txt or internal.hpp
+
+#ifndef DMITIGR_INTERNAL_CONCURRENCY_HPP
+#define DMITIGR_INTERNAL_CONCURRENCY_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace dmitigr::internal::concurrency {
+
+/**
+ * @internal
+ *
+ * @returns The number of threads to use to run the `task_count` tasks.
+ *
+ * @param task_count - The number of tasks to run.
+ * @param concurrency - The maximum number of threads to use, or `0` to use
+ * the value of `std::thread::hardware_concurrency()`.
+ */
+inline std::size_t thread_count(const std::size_t task_count, std::size_t concurrency) noexcept
+{
+  if (!concurrency)
+    concurrency = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  return std::min(task_count, concurrency);
+}
+
+/**
+ * @internal
+ *
+ * @brief Calls `f(i)` for each `i` in range [0, count) on the bounded pool of threads.
+ *
+ * The calling thread participates in the work. If some of the calls throws
+ * an exception, the rest calls which are not yet started are skipped and the
+ * first exception thrown is rethrown after all of the threads are joined.
+ *
+ * @param count - The number of calls.
+ * @param concurrency - The maximum number of threads to use (including the
+ * calling thread), or `0` to use the value of `std::thread::hardware_concurrency()`.
+ * @param f - The function to call.
+ */
+template<typename F>
+void for_each_index(const std::size_t count, const std::size_t concurrency, F&& f)
+{
+  std::atomic<std::size_t> next_index{};
+  std::atomic<bool> is_failed{};
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  const auto work = [&]
+  {
+    for (auto i = next_index.fetch_add(1, std::memory_order_relaxed); i < count && !is_failed.load(std::memory_order_relaxed);
+         i = next_index.fetch_add(1, std::memory_order_relaxed)) {
+      try {
+        f(i);
+      } catch (...) {
+        const std::lock_guard lg{error_mutex};
+        if (!error)
+          error = std::current_exception();
+        is_failed = true;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  if (const auto tc = thread_count(count, concurrency); tc > 1) {
+    threads.reserve(tc - 1);
+    for (std::size_t i = 0; i < tc - 1; ++i) {
+      try {
+        threads.emplace_back(work);
+      } catch (const std::system_error&) {
+        break; // the threads already started (and the calling thread) will do the work
+      }
+    }
+  }
+  work();
+  for (auto& thread : threads)
+    thread.join();
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+} // namespace dmitigr::internal::concurrency
+
+#endif  // DMITIGR_INTERNAL_CONCURRENCY_HPP
@@ -2,123 +2,906 @@
 // Copyright (C) Dmitry Igrishin
 // For conditions of distribution and use, see files LICENSE.txt or internal.hpp
 
+#include "dmitigr/internal/concurrency.hpp"
 #include "dmitigr/internal/config.hpp"
 #include "dmitigr/internal/debug.hpp"
-#include "dmitigr/internal/string.hpp"
+#include "dmitigr/internal/hash.hpp"
+#include "dmitigr/internal/stream.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <locale>
 #include <stdexcept>
-#include <tuple>
+#include <system_error>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
 
 #include "dmitigr/internal/implementation_header.hpp"
 
 namespace dmitigr::internal::config {
 
 DMITIGR_INTERNAL_INLINE Flat::Flat(const std::filesystem::path& path)
-  : parameters_{parsed_config(path)}
 {
+  auto storage = std::make_shared<std::string>();
+  if (std::ifstream stream{path, std::ios_base::in | std::ios_base::binary}) {
+    std::error_code ec;
+    if (const auto size = std::filesystem::file_size(path, ec); !ec) {
+      storage->resize(static_cast<std::size_t>(size));
+      stream.read(storage->data(), static_cast<std::streamsize>(size));
+      storage->resize(static_cast<std::size_t>(stream.gcount()));
+    }
+    // The file might be growing, or it might be not a regular file.
+    if (stream)
+      storage->append(stream::read_to_string(stream));
+  }
+  parse_config(std::move(storage));
+  set_file(path);
   DMITIGR_INTERNAL_ASSERT(is_invariant_ok());
 }
 
-DMITIGR_INTERNAL_INLINE const std::optional<std::string>& Flat::string_parameter(const std::string& name) const
+DMITIGR_INTERNAL_INLINE Flat Flat::from_string(std::string content)
+{
+  Flat result;
+  result.parse_config(std::make_shared<std::string>(std::move(content)));
+  DMITIGR_INTERNAL_ASSERT(result.is_invariant_ok());
+  return result;
+}
+
+DMITIGR_INTERNAL_INLINE std::optional<std::string_view> Flat::string_parameter(const std::string_view name) const noexcept
 {
-  if (const auto e = cend(parameters_), i = parameters_.find(name); i != e)
-    return i->second;
+  if (const auto* const p = parameter(name))
+    return p->value;
   else
-    return null_string_parameter();
+    return std::nullopt;
 }
 
-DMITIGR_INTERNAL_INLINE std::optional<bool> Flat::boolean_parameter(const std::string& name) const
+namespace {
+
+/**
+ * @internal
+ *
+ * @returns `true` if `a` and `b` are equal case-insensitively (ASCII).
+ */
+inline bool is_equal_nocase__(const std::string_view a, const std::string_view b) noexcept
 {
-  if (const auto& str_param = string_parameter(name)) {
-    const auto& str = *str_param;
-    if (str == "y" || str == "yes" || str == "t" || str == "true" || str == "1")
-      return true;
-    else if (str == "n" || str == "no" || str == "f" || str == "false" || str == "0")
-      return false;
-    else
-      throw std::runtime_error{"invalid value \"" + str + "\" of the boolean parameter \"" + name + "\""};
+  return a.size() == b.size() && std::equal(a.cbegin(), a.cend(), b.cbegin(),
+    [](const char x, const char y)
+    {
+      return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+    });
+}
+
+/**
+ * @internal
+ *
+ * @returns The `str` without the leading and trailing spaces.
+ */
+inline std::string_view trimmed__(std::string_view str) noexcept
+{
+  while (!str.empty() && std::isspace(static_cast<unsigned char>(str.front())))
+    str.remove_prefix(1);
+  while (!str.empty() && std::isspace(static_cast<unsigned char>(str.back())))
+    str.remove_suffix(1);
+  return str;
+}
+
+/**
+ * @brief Parses the integer at the beginning of `str`.
+ *
+ * @returns The remaining part of `str`, or `std::nullopt` if there is no integer.
+ */
+inline std::optional<std::string_view> parse_integer__(const std::string_view str, std::int64_t& result) noexcept
+{
+  const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), result);
+  if (ec != std::errc{})
+    return std::nullopt;
+  return str.substr(ptr - str.data());
+}
+
+inline bool parse_boolean__(const std::string_view str, std::uint64_t& result) noexcept
+{
+  if (str == "y" || str == "yes" || str == "t" || str == "true" || str == "1")
+    result = 1;
+  else if (str == "n" || str == "no" || str == "f" || str == "false" || str == "0")
+    result = 0;
+  else
+    return false;
+  return true;
+}
+
+inline bool parse_integer__(const std::string_view str, std::uint64_t& result) noexcept
+{
+  std::int64_t value;
+  const auto rest = parse_integer__(str, value);
+  if (!rest || !rest->empty())
+    return false;
+  result = static_cast<std::uint64_t>(value);
+  return true;
+}
+
+inline bool parse_floating__(std::string_view str, std::uint64_t& result) noexcept
+{
+  // Unlike the streams, std::from_chars() doesn't accept the leading plus.
+  if (str.size() > 1 && str[0] == '+' && str[1] != '-')
+    str.remove_prefix(1);
+  double value;
+  const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+  if (ec != std::errc{} || ptr != str.data() + str.size())
+    return false;
+  std::memcpy(&result, &value, sizeof(result));
+  return true;
+}
+
+inline bool parse_size__(const std::string_view str, std::uint64_t& result) noexcept
+{
+  std::int64_t value;
+  const auto rest = parse_integer__(str, value);
+  if (!rest || value < 0)
+    return false;
+  const auto unit = trimmed__(*rest);
+  int shift{};
+  if (unit.empty() || is_equal_nocase__(unit, "b"))
+    shift = 0;
+  else if (is_equal_nocase__(unit, "k") || is_equal_nocase__(unit, "kb") || is_equal_nocase__(unit, "kib"))
+    shift = 10;
+  else if (is_equal_nocase__(unit, "m") || is_equal_nocase__(unit, "mb") || is_equal_nocase__(unit, "mib"))
+    shift = 20;
+  else if (is_equal_nocase__(unit, "g") || is_equal_nocase__(unit, "gb") || is_equal_nocase__(unit, "gib"))
+    shift = 30;
+  else if (is_equal_nocase__(unit, "t") || is_equal_nocase__(unit, "tb") || is_equal_nocase__(unit, "tib"))
+    shift = 40;
+  else
+    return false;
+  const auto bytes = static_cast<std::uint64_t>(value);
+  if (shift && (bytes >> (64 - shift)))
+    return false; // overflow
+  result = bytes << shift;
+  return true;
+}
+
+inline bool parse_duration__(const std::string_view str, std::uint64_t& result) noexcept
+{
+  std::int64_t value;
+  const auto rest = parse_integer__(str, value);
+  if (!rest)
+    return false;
+  const auto unit = trimmed__(*rest);
+  std::int64_t multiplier{};
+  if (unit == "ns")
+    multiplier = 1;
+  else if (unit == "us")
+    multiplier = 1000;
+  else if (unit == "ms")
+    multiplier = 1000 * 1000;
+  else if (unit == "s")
+    multiplier = 1000 * 1000 * 1000;
+  else if (unit == "min")
+    multiplier = std::int64_t{60} * 1000 * 1000 * 1000;
+  else if (unit == "h")
+    multiplier = std::int64_t{3600} * 1000 * 1000 * 1000;
+  else if (unit == "d")
+    multiplier = std::int64_t{86400} * 1000 * 1000 * 1000;
+  else
+    return false;
+  if (value > INT64_MAX / multiplier || value < INT64_MIN / multiplier)
+    return false; // overflow
+  result = static_cast<std::uint64_t>(value * multiplier);
+  return true;
+}
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE std::optional<bool> Flat::boolean_parameter(const std::string_view name) const
+{
+  const auto bits = cached_parameter(name, Value_kind::boolean, "boolean", &parse_boolean__);
+  return bits ? std::make_optional(*bits != 0) : std::nullopt;
+}
+
+DMITIGR_INTERNAL_INLINE std::optional<std::int64_t> Flat::integer_parameter(const std::string_view name) const
+{
+  const auto bits = cached_parameter(name, Value_kind::integer, "integer", &parse_integer__);
+  return bits ? std::make_optional(static_cast<std::int64_t>(*bits)) : std::nullopt;
+}
+
+DMITIGR_INTERNAL_INLINE std::optional<double> Flat::floating_parameter(const std::string_view name) const
+{
+  if (const auto bits = cached_parameter(name, Value_kind::floating, "floating point", &parse_floating__)) {
+    double result;
+    std::memcpy(&result, &*bits, sizeof(result));
+    return result;
   } else
     return std::nullopt;
 }
 
-DMITIGR_INTERNAL_INLINE const std::map<std::string, std::optional<std::string>>& Flat::parameters() const
+DMITIGR_INTERNAL_INLINE std::optional<std::uint64_t> Flat::size_parameter(const std::string_view name) const
 {
-  return parameters_;
+  return cached_parameter(name, Value_kind::size, "size", &parse_size__);
 }
 
-DMITIGR_INTERNAL_INLINE std::pair<std::string, std::string> Flat::parsed_config_entry(const std::string& line)
+DMITIGR_INTERNAL_INLINE std::optional<std::chrono::nanoseconds> Flat::duration_parameter(const std::string_view name) const
 {
-  std::string param;
-  std::string value;
-  std::string::size_type pos = string::position_of_non_space(line, 0);
-  DMITIGR_INTERNAL_ASSERT(pos < line.size());
+  const auto bits = cached_parameter(name, Value_kind::duration, "duration", &parse_duration__);
+  return bits ? std::make_optional(std::chrono::nanoseconds{static_cast<std::int64_t>(*bits)}) : std::nullopt;
+}
+
+DMITIGR_INTERNAL_INLINE std::optional<std::size_t> Flat::enumerator_index(const std::string_view name,
+  const void* const values, const std::size_t count,
+  std::string_view (* const value_name)(const void*, std::size_t)) const
+{
+  const auto* const param = parameter(name);
+  if (!param)
+    return std::nullopt;
 
   /*
-   * @returns The position of the first character of a parameter value.
+   * The cached index is only the hint, since `values` may differ between the
+   * calls. (The list identity is not usable as the key, since the backing
+   * array of the initializer list may be a temporary.)
    */
-  static const auto position_of_value = [](const std::string& str, std::string::size_type pos)
+  auto& cached = cache_[param - parameters_.data()];
+  if (std::uint64_t result; cached.load(Value_kind::enumerator, result) &&
+    result < count && is_equal_nocase__(param->value, value_name(values, result)))
+    return static_cast<std::size_t>(result);
+
+  for (std::size_t i{}; i < count; ++i) {
+    if (is_equal_nocase__(param->value, value_name(values, i))) {
+      cached.store(Value_kind::enumerator, i);
+      return i;
+    }
+  }
+  throw std::runtime_error{"invalid value \"" + std::string{param->value} +
+    "\" of the enumeration parameter \"" + std::string{name} + "\" (line " +
+    std::to_string(param->line) + ")"};
+}
+
+DMITIGR_INTERNAL_INLINE std::optional<std::uint64_t> Flat::cached_parameter(const std::string_view name,
+  const Value_kind kind, const char* const kind_name, bool (* const parse)(std::string_view, std::uint64_t&)) const
+{
+  const auto* const param = parameter(name);
+  if (!param)
+    return std::nullopt;
+
+  /*
+   * The value of each kind is cached separately. The cache slot of the kind is
+   * claimed by the first parser. The others parse on their own.
+   */
+  auto& cached = cache_[param - parameters_.data()];
+  std::uint64_t result;
+  if (cached.load(kind, result))
+    return result;
+
+  if (!parse(param->value, result))
+    throw std::runtime_error{"invalid value \"" + std::string{param->value} +
+      "\" of the " + kind_name + " parameter \"" + std::string{name} + "\" (line " +
+      std::to_string(param->line) + ")"};
+  cached.store(kind, result);
+  return result;
+}
+
+DMITIGR_INTERNAL_INLINE auto Flat::parameter(const std::string_view name) const noexcept -> const Parameter*
+{
+  if (index_.empty())
+    return nullptr;
+
+  const auto hash = std::hash<std::string_view>{}(name);
+  const auto tag = index_tag(hash);
+  const auto mask = index_.size() - 1;
+  for (auto i = hash & mask;; i = (i + 1) & mask) {
+    const auto& slot = index_[i];
+    if (!slot.position)
+      return nullptr;
+    else if (slot.tag == tag) {
+      if (const auto& p = parameters_[slot.position - 1]; p.name == name)
+        return &p;
+    }
+  }
+}
+
+DMITIGR_INTERNAL_INLINE auto Flat::parameters() const noexcept -> const std::vector<Parameter>&
+{
+  return parameters_;
+}
+
+DMITIGR_INTERNAL_INLINE void Flat::parse_config(std::shared_ptr<std::string> storage)
+{
+  // The classification is performed with the global locale (as before).
+  const std::locale loc;
+  const auto& ctype = std::use_facet<std::ctype<char>>(loc);
+  const auto is_space = [&ctype](const char c) { return ctype.is(std::ctype_base::space, c); };
+  const auto is_alpha = [&ctype](const char c) { return ctype.is(std::ctype_base::alpha, c); };
+  const auto is_identifier = [&ctype](const char c)
   {
-    pos = string::position_of_non_space(str, pos);
-    if (pos < str.size() && str[pos] == '=')
-      return string::position_of_non_space(str, ++pos);
-    else
-      throw std::runtime_error{"no value assignment"};
+    return ctype.is(std::ctype_base::alnum, c) || c == '_';
   };
 
-  // Reading the parameter name.
-  std::tie(param, pos) = string::substring_if_simple_identifier(line, pos);
-  if (pos < line.size()) {
-    if (param.empty() || (!std::isspace(line[pos], std::locale{}) && line[pos] != '='))
-      throw std::runtime_error{"invalid parameter name"};
-  } else
-    throw std::runtime_error{"invalid configuration entry"};
-
-  // Reading the parameter value.
-  if (pos = position_of_value(line, pos); pos < line.size()) {
-    std::tie(value, pos) = string::unquoted_substring(line, pos);
-    DMITIGR_INTERNAL_ASSERT(!value.empty());
-    if (pos < line.size()) {
-      if (pos = string::position_of_non_space(line, pos); pos < line.size())
-        throw std::runtime_error{"junk in the config entry"};
+  char* const data = storage->data();
+  const std::size_t size = storage->size();
+  std::size_t line_number{};
+  const auto error = [&line_number](const char* const what)
+  {
+    return std::runtime_error{std::string{what} + " (line " + std::to_string(line_number) + ")"};
+  };
+  for (std::size_t line_begin{}; line_begin < size;) {
+    ++line_number;
+    const auto* const nl = static_cast<const char*>(std::memchr(data + line_begin, '\n', size - line_begin));
+    const std::size_t line_end = nl ? nl - data : size;
+    const std::size_t next_line_begin = line_end + 1;
+
+    // Skipping the spaces, empty and commented lines.
+    std::size_t pos = line_begin;
+    while (pos < line_end && is_space(data[pos]))
+      ++pos;
+    if (pos == line_end || data[pos] == '#') {
+      line_begin = next_line_begin;
+      continue;
     }
-  } // else the value is empty
 
-  return {std::move(param), std::move(value)};
+    // Reading the parameter name.
+    const std::size_t name_begin = pos;
+    if (is_alpha(data[pos])) {
+      while (pos < line_end && is_identifier(data[pos]))
+        ++pos;
+    }
+    const std::size_t name_end = pos;
+    if (pos < line_end) {
+      if (name_begin == name_end || (!is_space(data[pos]) && data[pos] != '='))
+        throw error("invalid parameter name");
+    } else
+      throw error("invalid configuration entry");
+
+    // Reading the value assignment.
+    while (pos < line_end && is_space(data[pos]))
+      ++pos;
+    if (pos < line_end && data[pos] == '=') {
+      ++pos;
+      while (pos < line_end && is_space(data[pos]))
+        ++pos;
+    } else
+      throw error("no value assignment");
+
+    // Reading the parameter value.
+    std::size_t value_begin = pos;
+    std::size_t value_end = pos;
+    if (pos < line_end) {
+      constexpr char quote_char = '\'';
+      constexpr char escape_char = '\\';
+      if (data[pos] == quote_char) {
+        // Unescaping in place: the output never outruns the input.
+        value_begin = value_end = ++pos;
+        bool is_escape{};
+        for (; pos < line_end; ++pos) {
+          const char ch = data[pos];
+          if (is_escape) {
+            if (ch != quote_char)
+              data[value_end++] = escape_char; // it's not escape, so preserve
+            data[value_end++] = ch;
+            is_escape = false;
+          } else if (ch == quote_char)
+            break;
+          else if (ch == escape_char)
+            is_escape = true;
+          else
+            data[value_end++] = ch;
+        }
+        if (pos == line_end && data[line_end - 1] != quote_char)
+          throw error("no trailing quote found");
+        pos = std::min(pos + 1, line_end); // discarding the trailing quote
+      } else {
+        while (pos < line_end && !is_space(data[pos]))
+          ++pos;
+        value_end = pos;
+      }
+
+      while (pos < line_end && is_space(data[pos]))
+        ++pos;
+      if (pos < line_end)
+        throw error("junk in the config entry");
+    } // else the value is empty
+
+    parameters_.push_back({std::string_view{data + name_begin, name_end - name_begin},
+      std::string_view{data + value_begin, value_end - value_begin}, line_number});
+    line_begin = next_line_begin;
+  }
+
+  std::stable_sort(begin(parameters_), end(parameters_),
+    [](const Parameter& lhs, const Parameter& rhs) { return lhs.name < rhs.name; });
+  parameters_.erase(std::unique(begin(parameters_), end(parameters_),
+      [](const Parameter& lhs, const Parameter& rhs) { return lhs.name == rhs.name; }),
+    end(parameters_));
+  storage_ = std::move(storage);
+  build_index();
 }
 
-DMITIGR_INTERNAL_INLINE std::map<std::string, std::optional<std::string>> Flat::parsed_config(const std::filesystem::path& path)
+DMITIGR_INTERNAL_INLINE void Flat::build_index()
 {
-  std::map<std::string, std::optional<std::string>> result;
-  static const auto is_nor_empty_nor_commented = [](const std::string& line)
+  parameters_.shrink_to_fit();
+  if (parameters_.size() >= UINT32_MAX)
+    throw std::runtime_error{"too many configuration parameters"};
+
+  // Build the hash index with the load factor not greater than 0.5.
+  if (!parameters_.empty()) {
+    std::size_t index_size{2};
+    while (index_size < parameters_.size() * 2)
+      index_size *= 2;
+    index_.resize(index_size);
+    const auto mask = index_size - 1;
+    for (std::size_t p{}; p < parameters_.size(); ++p) {
+      const auto hash = std::hash<std::string_view>{}(parameters_[p].name);
+      auto i = hash & mask;
+      while (index_[i].position)
+        i = (i + 1) & mask;
+      index_[i] = {index_tag(hash), static_cast<std::uint32_t>(p + 1)};
+    }
+  }
+
+  cache_.reset(new Cached_value[parameters_.size()]);
+}
+
+DMITIGR_INTERNAL_INLINE Flat Flat::from_directory(const std::filesystem::path& root,
+  const std::filesystem::path& extension, const Merge_policy policy, const bool recursive,
+  const std::size_t concurrency)
+{
+  auto paths = filesystem::files_by_extension(root, extension, recursive);
+  std::sort(begin(paths), end(paths));
+
+  std::vector<std::optional<Flat>> flats(paths.size());
+  concurrency::for_each_index(paths.size(), concurrency, [&paths, &flats](const std::size_t i)
   {
-    if (!line.empty())
-      if (const auto pos = string::position_of_non_space(line, 0); pos < line.size())
-        return line[pos] != '#';
-    return false;
-  };
-  const auto lines = filesystem::read_lines_to_vector_if(path, is_nor_empty_nor_commented);
-  for (std::size_t i = 0; i < lines.size(); ++i) {
     try {
-      result.insert(parsed_config_entry(lines[i]));
+      flats[i].emplace(paths[i]);
     } catch (const std::exception& e) {
-      throw std::runtime_error{std::string{e.what()} +" (line " + std::to_string(i + 1) + ")"};
+      throw std::runtime_error{paths[i].generic_string() + ": " + e.what()};
     }
+  });
+
+  // Merge the parameters in the order of the files.
+  Flat result;
+  auto files = std::make_shared<const std::vector<std::filesystem::path>>(std::move(paths));
+  auto storages = std::make_shared<std::vector<std::shared_ptr<const void>>>();
+  std::vector<Parameter> parameters;
+  for (std::size_t i{}; i < flats.size(); ++i) {
+    storages->push_back(flats[i]->storage_);
+    for (auto p : flats[i]->parameters_) {
+      p.file = &(*files)[i];
+      parameters.push_back(p);
+    }
+  }
+  std::stable_sort(begin(parameters), end(parameters),
+    [](const Parameter& lhs, const Parameter& rhs) { return lhs.name < rhs.name; });
+  for (auto i = cbegin(parameters); i != cend(parameters);) {
+    const auto j = std::find_if(i, cend(parameters),
+      [i](const Parameter& p) { return p.name != i->name; });
+    if (policy == Merge_policy::error_on_conflict && j - i > 1)
+      throw std::runtime_error{"parameter \"" + std::string{i->name} + "\" is specified in " +
+        i->file->generic_string() + " (line " + std::to_string(i->line) + ") and in " +
+        (i + 1)->file->generic_string() + " (line " + std::to_string((i + 1)->line) + ")"};
+    result.parameters_.push_back(*(j - 1));
+    i = j;
   }
+  result.storage_ = std::move(storages);
+  result.files_ = std::move(files);
+  result.build_index();
+  DMITIGR_INTERNAL_ASSERT(result.is_invariant_ok());
   return result;
 }
 
-DMITIGR_INTERNAL_INLINE bool Flat::is_invariant_ok() const
+DMITIGR_INTERNAL_INLINE void Flat::set_file(const std::filesystem::path& path)
 {
+  files_ = std::make_shared<const std::vector<std::filesystem::path>>(1, path);
+  for (auto& p : parameters_)
+    p.file = &files_->front();
+}
+
+#ifndef _WIN32
+
+namespace {
+
+/**
+ * @internal
+ *
+ * The header of the binary image.
+ */
+struct Image_header final {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t header_size;
+  std::uint64_t source_size;
+  std::int64_t source_mtime;
+  std::uint64_t entry_count;
+  std::uint64_t heap_offset;
+  std::uint64_t heap_size;
+  std::uint64_t checksum;
+};
+
+/**
+ * @internal
+ *
+ * The entry of the binary image.
+ */
+struct Image_entry final {
+  std::uint64_t name_offset;
+  std::uint64_t value_offset;
+  std::uint32_t name_size;
+  std::uint32_t value_size;
+  std::uint64_t line;
+};
+
+constexpr char image_magic__[8] = {'D', 'M', 'I', 'N', 'T', 'C', 'F', 'G'};
+constexpr std::uint32_t image_version__ = 1;
+
+/**
+ * @internal
+ *
+ * @returns The checksum of the `image` of `size` bytes (with the header).
+ */
+inline std::uint64_t image_checksum__(const char* const image, const std::size_t size) noexcept
+{
+  hash::Xxh64 result;
+  result.update(image, offsetof(Image_header, checksum));
+  result.update(image + sizeof(Image_header), size - sizeof(Image_header));
+  return result.digest();
+}
+
+/**
+ * @internal
+ *
+ * @returns The size and the time of the last modification of the file at `path`.
+ */
+inline std::optional<std::pair<std::uint64_t, std::int64_t>> source_state__(const std::filesystem::path& path)
+{
+  std::error_code ec;
+  const auto size = std::filesystem::file_size(path, ec);
+  if (ec)
+    return std::nullopt;
+  const auto mtime = std::filesystem::last_write_time(path, ec);
+  if (ec)
+    return std::nullopt;
+  return std::make_pair(static_cast<std::uint64_t>(size), static_cast<std::int64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count()));
+}
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE Flat::Flat(const std::filesystem::path& text_path,
+  const std::filesystem::path& image_path)
+{
+  if (!open_image(text_path, image_path))
+    *this = Flat{text_path};
+  DMITIGR_INTERNAL_ASSERT(is_invariant_ok());
+}
+
+DMITIGR_INTERNAL_INLINE void Flat::compile(const std::filesystem::path& text_path,
+  const std::filesystem::path& image_path)
+{
+  // The state is obtained before the parsing to not miss the concurrent change.
+  const auto state = source_state__(text_path);
+  if (!state)
+    throw std::runtime_error{"unable to open file \"" + text_path.generic_string() + "\""};
+  const Flat flat{text_path};
+
+  std::vector<Image_entry> entries;
+  entries.reserve(flat.parameters_.size());
+  std::uint64_t heap_size{};
+  for (const auto& p : flat.parameters_) {
+    if (p.name.size() > UINT32_MAX || p.value.size() > UINT32_MAX)
+      throw std::runtime_error{"too large configuration parameter \"" + std::string{p.name} + "\""};
+    entries.push_back({heap_size, heap_size + p.name.size(),
+      static_cast<std::uint32_t>(p.name.size()), static_cast<std::uint32_t>(p.value.size()),
+      p.line});
+    heap_size += p.name.size() + p.value.size();
+  }
+
+  std::string image(sizeof(Image_header), '\0');
+  image.reserve(sizeof(Image_header) + entries.size() * sizeof(Image_entry) + heap_size);
+  image.append(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(Image_entry));
+  const auto heap_offset = image.size();
+  for (const auto& p : flat.parameters_)
+    image.append(p.name).append(p.value);
+
+  Image_header header{};
+  std::memcpy(header.magic, image_magic__, sizeof(header.magic));
+  header.version = image_version__;
+  header.header_size = sizeof(Image_header);
+  header.source_size = state->first;
+  header.source_mtime = state->second;
+  header.entry_count = entries.size();
+  header.heap_offset = heap_offset;
+  header.heap_size = heap_size;
+  std::memcpy(image.data(), &header, sizeof(header));
+  header.checksum = image_checksum__(image.data(), image.size());
+  std::memcpy(image.data(), &header, sizeof(header));
+
+  filesystem::File_writer::Options options;
+  options.is_atomic = true;
+  filesystem::File_writer writer{image_path, options};
+  writer.write(image);
+  writer.commit();
+}
+
+DMITIGR_INTERNAL_INLINE bool Flat::open_image(const std::filesystem::path& text_path,
+  const std::filesystem::path& image_path)
+{
+  const int fd = ::open(image_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (::fstat(fd, &st) || static_cast<std::size_t>(st.st_size) < sizeof(Image_header)) {
+    ::close(fd);
+    return false;
+  }
+  const auto size = static_cast<std::size_t>(st.st_size);
+  void* const data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return false;
+  std::shared_ptr<const void> mapping{data, [size](const void* const data)
+  {
+    ::munmap(const_cast<void*>(data), size);
+  }};
+  const auto* const image = static_cast<const char*>(data);
+
+  // Validate the header.
+  Image_header header;
+  std::memcpy(&header, image, sizeof(header));
+  if (std::memcmp(header.magic, image_magic__, sizeof(header.magic)) ||
+    header.version != image_version__ || header.header_size != sizeof(Image_header) ||
+    header.entry_count > (size - sizeof(Image_header)) / sizeof(Image_entry) ||
+    header.heap_offset != sizeof(Image_header) + header.entry_count * sizeof(Image_entry) ||
+    header.heap_size != size - header.heap_offset)
+    return false;
+
+  // Check the staleness and the integrity.
+  const auto state = source_state__(text_path);
+  if (!state || state->first != header.source_size || state->second != header.source_mtime ||
+    image_checksum__(image, size) != header.checksum)
+    return false;
+
+  // Reference the parameters in place.
+  const auto* const entries = reinterpret_cast<const Image_entry*>(image + sizeof(Image_header));
+  const auto* const heap = image + header.heap_offset;
+  std::vector<Parameter> parameters;
+  parameters.reserve(static_cast<std::size_t>(header.entry_count));
+  for (std::size_t i{}; i < header.entry_count; ++i) {
+    const auto& e = entries[i];
+    if (e.name_offset + e.name_size > header.heap_size || e.value_offset + e.value_size > header.heap_size)
+      return false;
+    parameters.push_back({std::string_view{heap + e.name_offset, e.name_size},
+      std::string_view{heap + e.value_offset, e.value_size}, static_cast<std::size_t>(e.line)});
+  }
+  parameters_ = std::move(parameters);
+  storage_ = std::move(mapping);
+  set_file(text_path);
+  build_index();
   return true;
 }
 
-DMITIGR_INTERNAL_INLINE const std::optional<std::string>& Flat::null_string_parameter()
+#endif  // _WIN32
+
+DMITIGR_INTERNAL_INLINE bool Flat::is_invariant_ok() const
 {
-  static const std::optional<std::string> result;
+  return std::is_sorted(cbegin(parameters_), cend(parameters_),
+    [](const Parameter& lhs, const Parameter& rhs) { return lhs.name < rhs.name; });
+}
+
+// -----------------------------------------------------------------------------
+
+DMITIGR_INTERNAL_INLINE Reloadable_flat::Reloadable_flat(std::filesystem::path path)
+  : Reloadable_flat{std::move(path), Options{}}
+{}
+
+DMITIGR_INTERNAL_INLINE Reloadable_flat::Reloadable_flat(std::filesystem::path path,
+  const Options& options, Error_handler error_handler)
+  : path_{std::move(path)}
+  , options_{options}
+  , error_handler_{std::move(error_handler)}
+{
+  File_state state;
+  publish(load(state), state);
+
+  if (!options_.is_watched)
+    return;
+
+#ifdef __linux__
+  wake_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+#endif
+  watcher_ = std::thread{&Reloadable_flat::watch, this};
+}
+
+DMITIGR_INTERNAL_INLINE Reloadable_flat::~Reloadable_flat()
+{
+  if (watcher_.joinable()) {
+    {
+      const std::lock_guard lg{watch_mutex_};
+      is_watch_stopped_ = true;
+    }
+    watch_condition_.notify_all();
+#ifdef __linux__
+    if (wake_fd_ >= 0) {
+      const std::uint64_t one{1};
+      (void)!::write(wake_fd_, &one, sizeof(one));
+    }
+#endif
+    watcher_.join();
+  }
+#ifdef __linux__
+  if (wake_fd_ >= 0)
+    ::close(wake_fd_);
+#endif
+}
+
+DMITIGR_INTERNAL_INLINE std::shared_ptr<const Flat> Reloadable_flat::snapshot() const
+{
+  return std::atomic_load(&snapshot_);
+}
+
+DMITIGR_INTERNAL_INLINE bool Reloadable_flat::reload()
+{
+  std::exception_ptr error;
+  {
+    /*
+     * The reloads are serialized, so the snapshot of the older file cannot
+     * be published after the snapshot of the newer one.
+     */
+    const std::lock_guard lg{publication_mutex_};
+    File_state state;
+    try {
+      auto snapshot = load(state);
+      publish(std::move(snapshot), state);
+      return true;
+    } catch (const std::exception&) {
+      error = std::current_exception();
+      // Remember the state to not report the same error repeatedly.
+      const std::lock_guard lg{file_state_mutex_};
+      file_state_ = state;
+    }
+  }
+  report(error);
+  return false;
+}
+
+DMITIGR_INTERNAL_INLINE void Reloadable_flat::report(const std::exception_ptr error) const noexcept
+{
+  if (!error_handler_)
+    return;
+
+  try {
+    std::rethrow_exception(error);
+  } catch (const std::exception& e) {
+    error_handler_(e);
+  } catch (...) {}
+}
+
+DMITIGR_INTERNAL_INLINE auto Reloadable_flat::file_state() const -> File_state
+{
+  File_state result;
+  std::error_code ec;
+  result.is_exists = std::filesystem::is_regular_file(path_, ec);
+  if (result.is_exists) {
+    result.last_write_time = std::filesystem::last_write_time(path_, ec);
+    result.size = std::filesystem::file_size(path_, ec);
+  }
   return result;
 }
 
+DMITIGR_INTERNAL_INLINE std::shared_ptr<const Flat> Reloadable_flat::load(File_state& state) const
+{
+  // The state is obtained before the parsing to not miss the concurrent change.
+  state = file_state();
+  if (!state.is_exists)
+    // Flat treats the missing file as empty, which is not a valid reload.
+    throw std::runtime_error{"configuration file " + path_.string() + " not found"};
+  return std::make_shared<const Flat>(path_);
+}
+
+DMITIGR_INTERNAL_INLINE void Reloadable_flat::publish(std::shared_ptr<const Flat> snapshot,
+  const File_state& state)
+{
+  const std::lock_guard lg{file_state_mutex_};
+  std::atomic_store(&snapshot_, std::move(snapshot));
+  file_state_ = state;
+  generation_.fetch_add(1, std::memory_order_release);
+}
+
+DMITIGR_INTERNAL_INLINE void Reloadable_flat::watch()
+{
+#ifdef __linux__
+  /*
+   * The directory is watched rather than the file itself, since editors and
+   * deployment tools often replace the file by renaming.
+   */
+  int inotify_fd{-1};
+  if (wake_fd_ >= 0) {
+    auto dir = path_.parent_path();
+    if (dir.empty())
+      dir = ".";
+    inotify_fd = ::inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify_fd >= 0 && ::inotify_add_watch(inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+      ::close(inotify_fd);
+      inotify_fd = -1;
+    }
+  }
+
+  if (inotify_fd >= 0) {
+    const auto filename = path_.filename().string();
+    alignas(inotify_event) char buffer[4096];
+    bool is_failed{};
+    while (true) {
+      ::pollfd fds[2] = {{wake_fd_, POLLIN, 0}, {inotify_fd, POLLIN, 0}};
+      if (::poll(fds, 2, -1) < 0 && errno != EINTR) {
+        // Report the error and fall back to the polling.
+        const int err = errno;
+        report(std::make_exception_ptr(std::system_error{err, std::system_category(),
+              "dmitigr::internal::config::Reloadable_flat: unable to watch file " + path_.string()}));
+        is_failed = true;
+        break;
+      } else if (fds[0].revents)
+        break;
+
+      bool is_file_event{};
+      if (fds[1].revents & POLLIN) {
+        for (ssize_t size; (size = ::read(inotify_fd, buffer, sizeof(buffer))) > 0;) {
+          for (const char* p = buffer; p < buffer + size;) {
+            const auto* const event = reinterpret_cast<const inotify_event*>(p);
+            if (event->len && filename == event->name)
+              is_file_event = true;
+            p += sizeof(inotify_event) + event->len;
+          }
+        }
+      }
+      if (is_file_event)
+        reload();
+    }
+    ::close(inotify_fd);
+    if (!is_failed)
+      return;
+  }
+#endif
+
+  /*
+   * Polling. The file is reloaded only after its state has remained unchanged
+   * for the poll interval, so the file which is being written in place is
+   * not read half-written.
+   */
+  std::optional<File_state> changed_state;
+  while (true) {
+    {
+      std::unique_lock lk{watch_mutex_};
+      if (watch_condition_.wait_for(lk, options_.poll_interval,
+          [this] { return is_watch_stopped_; }))
+        break;
+    }
+    const auto state = file_state();
+    const bool is_changed = [&]
+    {
+      const std::lock_guard lg{file_state_mutex_};
+      return !(state == file_state_);
+    }();
+    if (!is_changed)
+      changed_state.reset();
+    else if (changed_state && *changed_state == state) {
+      changed_state.reset();
+      reload();
+    } else
+      changed_state = state;
+  }
+}
+
 } // namespace dmitigr::internal::config
 
 #include "dmitigr/internal/implementation_footer.hpp"
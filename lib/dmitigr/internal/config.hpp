@@ -9,48 +9,511 @@
 
 #include "dmitigr/internal/filesystem.hpp"
 
-#include <map>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <utility>
+#include <vector>
 
 namespace dmitigr::internal::config {
 
 /**
  * @brief Class Flat represents a flat configuration store.
+ *
+ * @details The names and the values of the parameters are stored contiguously
+ * in the single immutable buffer which is shared between the copies. The
+ * parameters are sorted by name and indexed by the open addressing hash table
+ * of their positions, so the lookup touches a couple of cache lines and
+ * doesn't allocate.
  */
 class Flat {
 public:
+  /**
+   * @brief Represents a parameter.
+   */
+  struct Parameter final {
+    /** The name of the parameter. */
+    std::string_view name;
+
+    /** The value of the parameter. (Empty if the value is not specified.) */
+    std::string_view value;
+
+    /** The number of the line of the configuration file. */
+    std::size_t line{};
+
+    /** The path of the configuration file, or `nullptr` if unknown. */
+    const std::filesystem::path* file{};
+  };
+
+  /**
+   * @brief The policy of merging of the parameters specified in several files.
+   */
+  enum class Merge_policy {
+    /** The value from the last file wins. */
+    last_wins,
+
+    /** The parameter specified in several files is an error. */
+    error_on_conflict
+  };
+
+  /**
+   * @brief Loads the configuration from the file at `path`.
+   *
+   * @details The file is read at once and parsed in place. If the file cannot
+   * be opened, the configuration is empty.
+   *
+   * @see from_string().
+   */
   DMITIGR_INTERNAL_API explicit Flat(const std::filesystem::path& path);
 
-  DMITIGR_INTERNAL_API const std::optional<std::string>& string_parameter(const std::string& name) const;
+  /**
+   * @returns The configuration parsed from `content`. The format of each line
+   * can be:
+   *   - "param=one";
+   *   - "param='one two  three'";
+   *   - "param='one \\'two three\\' four'".
+   *
+   * Empty lines and lines starting with '#' are ignored. If the parameter is
+   * specified more than once, the first value is used.
+   *
+   * @throws `std::runtime_error` with the number of the invalid line.
+   */
+  DMITIGR_INTERNAL_API static Flat from_string(std::string content);
 
-  DMITIGR_INTERNAL_API std::optional<bool> boolean_parameter(const std::string& name) const;
+  /**
+   * @brief Loads and merges the configuration files found by
+   * `filesystem::files_by_extension(root, extension, recursive)`.
+   *
+   * @details The files are parsed concurrently, and merged in the order of
+   * their paths according to the `policy`. (Within a file, the first value of
+   * the parameter is used as usual.)
+   *
+   * @param concurrency The maximum number of threads (including the calling
+   * thread), or `0` to use the value of `std::thread::hardware_concurrency()`.
+   *
+   * @throws `std::runtime_error` with the path of the invalid file, or with
+   * the locations of the conflicting parameter.
+   */
+  DMITIGR_INTERNAL_API static Flat from_directory(const std::filesystem::path& root,
+    const std::filesystem::path& extension = ".conf", Merge_policy policy = Merge_policy::last_wins,
+    bool recursive = false, std::size_t concurrency = 0);
+
+#ifndef _WIN32
+  /**
+   * @brief Loads the configuration from the binary image at `image_path`
+   * compiled from the file at `text_path`, or from the file at `text_path`
+   * if the image is missing, invalid or stale (i.e. the size or the time of
+   * the last modification of the file differs from the recorded in the image).
+   *
+   * @details The image is mapped into memory and checked against its checksum,
+   * and the parameters are referenced in place without parsing.
+   *
+   * @see compile().
+   */
+  DMITIGR_INTERNAL_API Flat(const std::filesystem::path& text_path,
+    const std::filesystem::path& image_path);
+
+  /**
+   * @brief Compiles the configuration file at `text_path` into the binary image
+   * at `image_path`. The image is replaced atomically.
+   *
+   * @details The image consists of the header (the magic, the format version,
+   * the size and the time of the last modification of the source file, the
+   * number of entries, the location of the heap and the XXH64 checksum of the
+   * image), the table of the entries sorted by name (the offsets and the sizes
+   * of the name and the value in the heap, the line number), and the heap of
+   * the names and the values.
+   */
+  DMITIGR_INTERNAL_API static void compile(const std::filesystem::path& text_path,
+    const std::filesystem::path& image_path);
+#endif
 
-  DMITIGR_INTERNAL_API const std::map<std::string, std::optional<std::string>>& parameters() const;
+  /**
+   * @returns The value of the parameter `name`, or `std::nullopt` if there is
+   * no such a parameter.
+   *
+   * @remarks The returned view is valid as long as this instance (or its copy)
+   * exists.
+   */
+  DMITIGR_INTERNAL_API std::optional<std::string_view> string_parameter(std::string_view name) const noexcept;
+
+  /**
+   * @returns The value of the boolean parameter `name`, or `std::nullopt` if
+   * there is no such a parameter.
+   *
+   * @details The valid values are: "y", "yes", "t", "true", "1", "n", "no",
+   * "f", "false", "0".
+   *
+   * @throws `std::runtime_error` if the value is invalid.
+   *
+   * @remarks The typed accessors parse the value on the first access and
+   * cache the result, so the subsequent calls don't parse it again.
+   */
+  DMITIGR_INTERNAL_API std::optional<bool> boolean_parameter(std::string_view name) const;
+
+  /**
+   * @returns The value of the integer parameter `name`, or `std::nullopt` if
+   * there is no such a parameter.
+   *
+   * @throws `std::runtime_error` if the value is invalid.
+   */
+  DMITIGR_INTERNAL_API std::optional<std::int64_t> integer_parameter(std::string_view name) const;
+
+  /**
+   * @returns The value of the floating point parameter `name`, or `std::nullopt`
+   * if there is no such a parameter.
+   *
+   * @throws `std::runtime_error` if the value is invalid.
+   */
+  DMITIGR_INTERNAL_API std::optional<double> floating_parameter(std::string_view name) const;
+
+  /**
+   * @returns The value (in bytes) of the size parameter `name`, or `std::nullopt`
+   * if there is no such a parameter.
+   *
+   * @details The value is an integer optionally followed by the unit: "B",
+   * "kB", "MB", "GB", "TB" (the multiples of 1024, case-insensitive, "K", "KiB"
+   * etc are accepted as well).
+   *
+   * @throws `std::runtime_error` if the value is invalid.
+   */
+  DMITIGR_INTERNAL_API std::optional<std::uint64_t> size_parameter(std::string_view name) const;
+
+  /**
+   * @returns The value of the duration parameter `name`, or `std::nullopt` if
+   * there is no such a parameter.
+   *
+   * @details The value is an integer followed by the unit: "ns", "us", "ms",
+   * "s", "min", "h", "d".
+   *
+   * @throws `std::runtime_error` if the value is invalid.
+   */
+  DMITIGR_INTERNAL_API std::optional<std::chrono::nanoseconds> duration_parameter(std::string_view name) const;
+
+  /**
+   * @returns The value of the enumeration parameter `name`, or `std::nullopt`
+   * if there is no such a parameter.
+   *
+   * @param values The mapping of the valid values (case-insensitive) to the
+   * enumerators. The index of the matched value is cached, so the calls with
+   * the same `values` for the same `name` don't rescan the list.
+   *
+   * @throws `std::runtime_error` if the value is invalid.
+   */
+  template<typename E>
+  std::optional<E> enum_parameter(const std::string_view name,
+    const std::initializer_list<std::pair<std::string_view, E>> values) const
+  {
+    using Value = std::pair<std::string_view, E>;
+    const auto index = enumerator_index(name, values.begin(), values.size(),
+      [](const void* const values, const std::size_t i)
+      {
+        return static_cast<const Value*>(values)[i].first;
+      });
+    return index ? std::make_optional(values.begin()[*index].second) : std::nullopt;
+  }
+
+  /**
+   * @returns The pointer to the parameter `name`, or `nullptr` if there is no
+   * such a parameter.
+   */
+  DMITIGR_INTERNAL_API const Parameter* parameter(std::string_view name) const noexcept;
+
+  /** @returns The parameters sorted by name. */
+  DMITIGR_INTERNAL_API const std::vector<Parameter>& parameters() const noexcept;
 
 private:
+  Flat() = default;
+
   /**
-   * @returns Parsed config entry. The format of `line` can be:
-   *   - "param=one";
-   *   - "param='one two  three';
-   *   - "param='one \'two three\' four'.
+   * @brief Parses the configuration in the `storage` in place (the escaped
+   * values are unescaped in place) in the single pass.
    */
-  std::pair<std::string, std::string> parsed_config_entry(const std::string& line);
+  void parse_config(std::shared_ptr<std::string> storage);
 
   /**
-   * @returns Parsed config file. The format of `line` can be:
-   *   - "param=one";
-   *   - "param='one two  three';
-   *   - "param='one \'two three\' four'.
+   * @internal
+   *
+   * Finishes the initialization with the parameters sorted by name.
+   */
+  void build_index();
+
+  /**
+   * @internal
+   *
+   * Sets the file of the parameters to `path`.
+   */
+  void set_file(const std::filesystem::path& path);
+
+#ifndef _WIN32
+  /**
+   * @brief Opens the image.
+   *
+   * @returns `false` if the image is missing, invalid or stale.
    */
-  std::map<std::string, std::optional<std::string>> parsed_config(const std::filesystem::path& path);
+  bool open_image(const std::filesystem::path& text_path, const std::filesystem::path& image_path);
+#endif
 
   bool is_invariant_ok() const;
 
-  static const std::optional<std::string>& null_string_parameter();
+  /**
+   * @internal
+   *
+   * The kind of the cached value.
+   */
+  enum class Value_kind : std::uint8_t {
+    boolean = 1,
+    integer,
+    floating,
+    size,
+    duration,
+    enumerator
+  };
+
+  /**
+   * @internal
+   *
+   * The cached values of the parameter (of each kind).
+   */
+  struct Cached_value final {
+    /** The pairs of bits (claimed, ready) of each kind. */
+    std::atomic<std::uint16_t> states{};
+    std::uint64_t bits[6]{};
+
+    /** @returns `true` and sets `result` if the value of `kind` is ready. */
+    bool load(const Value_kind kind, std::uint64_t& result) const noexcept
+    {
+      const auto index = static_cast<unsigned>(kind) - 1;
+      if (!(states.load(std::memory_order_acquire) & (2U << 2 * index)))
+        return false;
+      result = bits[index];
+      return true;
+    }
+
+    /** Caches the `value` of `kind` unless it's claimed by another thread. */
+    void store(const Value_kind kind, const std::uint64_t value) noexcept
+    {
+      const auto index = static_cast<unsigned>(kind) - 1;
+      const auto claimed = static_cast<std::uint16_t>(1U << 2 * index);
+      if (!(states.fetch_or(claimed, std::memory_order_acquire) & claimed)) {
+        bits[index] = value;
+        states.fetch_or(static_cast<std::uint16_t>(2U << 2 * index), std::memory_order_release);
+      }
+    }
+  };
+
+  /**
+   * @internal
+   *
+   * The slot of the hash index.
+   */
+  struct Index_slot final {
+    /** The high bits of the hash of the name. */
+    std::uint32_t tag{};
+
+    /** The position of the parameter plus one, or `0` if the slot is empty. */
+    std::uint32_t position{};
+  };
+
+  std::shared_ptr<const void> storage_; // owns the memory of names and values
+  std::shared_ptr<const std::vector<std::filesystem::path>> files_;
+  std::vector<Parameter> parameters_;
+  std::vector<Index_slot> index_;
+  std::shared_ptr<Cached_value[]> cache_;
+
+  static std::uint32_t index_tag(std::size_t hash) noexcept
+  {
+    return static_cast<std::uint32_t>(hash >> (sizeof(hash) * 4));
+  }
+
+  /**
+   * @returns The bits of the value of the parameter `name` parsed by `parse`,
+   * or `std::nullopt` if there is no such a parameter.
+   */
+  std::optional<std::uint64_t> cached_parameter(std::string_view name, Value_kind kind,
+    const char* kind_name, bool (*parse)(std::string_view, std::uint64_t&)) const;
+
+  DMITIGR_INTERNAL_API std::optional<std::size_t> enumerator_index(std::string_view name,
+    const void* values, std::size_t count,
+    std::string_view (*value_name)(const void*, std::size_t)) const;
+};
+
+/**
+ * @brief Class Reloadable_flat represents a holder of the flat configuration
+ * which is reloaded when the configuration file changes.
+ *
+ * @details The file is watched by the background thread (with inotify on
+ * Linux and by polling its status otherwise). When polling, the file is reloaded
+ * once its status has remained unchanged for the poll interval. Each successfully parsed
+ * configuration is published as the new immutable snapshot. If the file cannot
+ * be parsed, the previous snapshot remains current and the error is reported
+ * to the error handler.
+ *
+ * Readers on hot paths should use the Reader, which doesn't take locks unless
+ * the new snapshot has been published since its previous use.
+ */
+class Reloadable_flat final {
+public:
+  /**
+   * @brief Represents the options of the holder.
+   */
+  struct Options final {
+    /** The interval of the polling of the file status (when inotify is unavailable). */
+    std::chrono::milliseconds poll_interval{std::chrono::seconds{1}};
+
+    /** The indicator of watching the file in the background. */
+    bool is_watched{true};
+  };
+
+  /**
+   * @brief The type of the error handler. It's called from the thread which
+   * reloads the configuration and must not throw.
+   */
+  using Error_handler = std::function<void(const std::exception&)>;
+
+  /**
+   * @brief Represents a reader of the current snapshot.
+   *
+   * @details The reader holds the snapshot it has seen last, and checks the
+   * generation of the holder (by the single atomic load) on each access. The
+   * reader is intended to be used by one thread.
+   */
+  class Reader final {
+  public:
+    /** The constructor. */
+    explicit Reader(const Reloadable_flat& holder)
+      : holder_{&holder}
+    {
+      get();
+    }
+
+    /** @returns The current snapshot. */
+    const Flat& get()
+    {
+      const auto generation = holder_->generation_.load(std::memory_order_acquire);
+      if (generation != generation_) {
+        snapshot_ = holder_->snapshot();
+        generation_ = generation;
+      }
+      return *snapshot_;
+    }
+
+    /** @returns `get()`. */
+    const Flat& operator*()
+    {
+      return get();
+    }
+
+    /** @returns `&get()`. */
+    const Flat* operator->()
+    {
+      return &get();
+    }
+
+  private:
+    const Reloadable_flat* holder_{};
+    std::uint64_t generation_{};
+    std::shared_ptr<const Flat> snapshot_;
+  };
+
+  /**
+   * @brief Loads the configuration and starts watching the file with the
+   * default options.
+   *
+   * @see Reloadable_flat(std::filesystem::path, const Options&, Error_handler).
+   */
+  DMITIGR_INTERNAL_API explicit Reloadable_flat(std::filesystem::path path);
+
+  /**
+   * @brief Loads the configuration and starts watching the file if
+   * `options.is_watched`.
+   *
+   * @throws If the initial configuration cannot be loaded.
+   */
+  DMITIGR_INTERNAL_API Reloadable_flat(std::filesystem::path path,
+    const Options& options, Error_handler error_handler = {});
+
+  /** Stops watching the file. */
+  DMITIGR_INTERNAL_API ~Reloadable_flat();
+
+  /** Non copy-constructible. */
+  Reloadable_flat(const Reloadable_flat&) = delete;
+
+  /** Non copy-assignable. */
+  Reloadable_flat& operator=(const Reloadable_flat&) = delete;
+
+  /** @returns The current snapshot. */
+  DMITIGR_INTERNAL_API std::shared_ptr<const Flat> snapshot() const;
+
+  /** @returns The number of the snapshots published so far. */
+  std::uint64_t generation() const noexcept
+  {
+    return generation_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Reloads the configuration now.
+   *
+   * @returns `true` if the new snapshot has been published, or `false` if
+   * the error is reported to the error handler.
+   */
+  DMITIGR_INTERNAL_API bool reload();
+
+  /** @returns The path of the configuration file. */
+  const std::filesystem::path& path() const noexcept
+  {
+    return path_;
+  }
+
+private:
+  struct File_state final {
+    bool is_exists{};
+    std::filesystem::file_time_type last_write_time;
+    std::uintmax_t size{};
+
+    bool operator==(const File_state& rhs) const noexcept
+    {
+      return is_exists == rhs.is_exists && last_write_time == rhs.last_write_time && size == rhs.size;
+    }
+  };
+
+  std::filesystem::path path_;
+  Options options_;
+  Error_handler error_handler_;
+  std::shared_ptr<const Flat> snapshot_;
+  std::atomic<std::uint64_t> generation_{};
+  /*
+   * The publication_mutex_ serializes the loading and publication of the
+   * snapshots by reload(). The file_state_mutex_ guards the file_state_ (and
+   * the store of the snapshot_ along with it). If both are needed, the
+   * publication_mutex_ is locked first.
+   */
+  std::mutex publication_mutex_;
+  std::mutex file_state_mutex_;
+  File_state file_state_;
+
+  std::mutex watch_mutex_;
+  std::condition_variable watch_condition_;
+  bool is_watch_stopped_{};
+  int wake_fd_{-1};
+  std::thread watcher_;
 
-  std::map<std::string, std::optional<std::string>> parameters_;
+  File_state file_state() const;
+  std::shared_ptr<const Flat> load(File_state& state) const;
+  void publish(std::shared_ptr<const Flat> snapshot, const File_state& state);
+  void report(std::exception_ptr error) const noexcept;
+  void watch();
 };
 
 } // namespace dmitigr::internal::config
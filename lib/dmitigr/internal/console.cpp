@@ -2,15 +2,95 @@
 // Copyright (C) Dmitry Igrishin
 // For conditions of distribution and use, see files LICENSE.txt or internal.hpp
 
+#include "dmitigr/internal/concurrency.hpp"
 #include "dmitigr/internal/console.hpp"
 #include "dmitigr/internal/debug.hpp"
+#include "dmitigr/internal/os.hpp"
+#include "dmitigr/internal/stream.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <list>
+#include <sstream>
 #include <stdexcept>
+#include <streambuf>
+#include <system_error>
+#include <thread>
+
+#ifndef _WIN32
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#endif
 
 #include "dmitigr/internal/implementation_header.hpp"
 
 namespace dmitigr::internal::console {
 
+namespace detail {
+
+DMITIGR_INTERNAL_INLINE void parse_option_value__(const std::string_view option,
+  const Option_type type, const std::string_view value, void* const field)
+{
+  DMITIGR_INTERNAL_ASSERT(field);
+  const auto from_chars = [&value](auto& result)
+  {
+    const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+    return ec == std::errc{} && ptr == value.data() + value.size();
+  };
+
+  bool is_valid{true};
+  switch (type) {
+  case Option_type::boolean:
+    if (value == "y" || value == "yes" || value == "t" || value == "true" || value == "1")
+      *static_cast<bool*>(field) = true;
+    else if (value == "n" || value == "no" || value == "f" || value == "false" || value == "0")
+      *static_cast<bool*>(field) = false;
+    else
+      is_valid = false;
+    break;
+  case Option_type::integer:
+    is_valid = from_chars(*static_cast<std::int64_t*>(field));
+    break;
+  case Option_type::floating:
+    is_valid = from_chars(*static_cast<double*>(field));
+    break;
+  case Option_type::string:
+    *static_cast<std::string_view*>(field) = value;
+    break;
+  }
+  if (!is_valid)
+    throw std::logic_error{std::string{"invalid value \""}.append(value)
+      .append("\" of the option \"--").append(option).append("\"")};
+}
+
+DMITIGR_INTERNAL_INLINE std::string_view option_type_name__(const Option_type type) noexcept
+{
+  switch (type) {
+  case Option_type::boolean: return "boolean";
+  case Option_type::integer: return "integer";
+  case Option_type::floating: return "number";
+  case Option_type::string: return "string";
+  }
+  return {};
+}
+
+DMITIGR_INTERNAL_INLINE void throw_option_error__(const std::string_view details,
+  const std::string_view option)
+{
+  throw std::logic_error{std::string{details}.append(" \"--").append(option).append("\"")};
+}
+
+} // namespace detail
+
 DMITIGR_INTERNAL_INLINE void Command::throw_invalid_usage(std::string details) const
 {
   std::string message = "invalid usage of the \"" + name() + "\" command\n";
@@ -46,11 +126,766 @@ DMITIGR_INTERNAL_INLINE void Command::check_no_option_argument(const std::string
  */
 DMITIGR_INTERNAL_INLINE auto Command::parse_options(Option_iterator i, const Option_iterator e, Option_parser parse_option) -> Option_iterator
 {
-  for (; i != e && *i != "--" && (i->find("--") == 0); ++i)
+  for (; i != e && *i != "--" && (i->compare(0, 2, "--") == 0); ++i)
     parse_option(*i);
   return i;
 }
 
+DMITIGR_INTERNAL_INLINE std::vector<std::string_view> argument_views(const int argc, const char* const* const argv)
+{
+  DMITIGR_INTERNAL_ASSERT(argc > 0 && argv);
+  return std::vector<std::string_view>(argv + 1, argv + argc);
+}
+
+// -----------------------------------------------------------------------------
+// Command_registry
+// -----------------------------------------------------------------------------
+
+DMITIGR_INTERNAL_INLINE void Command_registry::add(const std::string_view name, Factory factory,
+  const std::initializer_list<std::string_view> aliases)
+{
+  DMITIGR_INTERNAL_ASSERT(!name.empty() && factory);
+
+  const auto check = [this](const std::string_view key)
+  {
+    if (key.empty() || index_.count(key))
+      throw std::logic_error{std::string{"command \""}.append(key).append("\" is already registered")};
+  };
+  check(name);
+  for (const auto alias : aliases)
+    check(alias);
+
+  const auto command = commands_.size();
+  const auto add_key = [this, command](const std::string_view key)
+  {
+    const std::string_view stored{strings_.emplace_back(key)};
+    index_.emplace(stored, command);
+    const auto pos = std::lower_bound(sorted_index_.begin(), sorted_index_.end(), stored,
+      [](const auto& entry, const std::string_view key) { return entry.first < key; });
+    sorted_index_.emplace(pos, stored, command);
+    return stored;
+  };
+  commands_.push_back(Command_entry{add_key(name), std::move(factory)});
+  for (const auto alias : aliases)
+    add_key(alias);
+}
+
+DMITIGR_INTERNAL_INLINE std::optional<std::size_t> Command_registry::command_index(const std::string_view name) const
+{
+  if (const auto i = index_.find(name); i != index_.cend())
+    return i->second;
+
+  // Lookup by the prefix. The keys with the same prefix are adjacent.
+  auto i = std::lower_bound(sorted_index_.cbegin(), sorted_index_.cend(), name,
+    [](const auto& entry, const std::string_view key) { return entry.first < key; });
+  const auto is_prefixed = [name](const auto& entry)
+  {
+    return entry.first.compare(0, name.size(), name) == 0;
+  };
+  if (name.empty() || i == sorted_index_.cend() || !is_prefixed(*i))
+    return std::nullopt;
+
+  const auto result = i->second;
+  std::string candidates;
+  bool is_ambiguous{};
+  for (; i != sorted_index_.cend() && is_prefixed(*i); ++i) {
+    is_ambiguous = is_ambiguous || i->second != result;
+    candidates.append(candidates.empty() ? "" : ", ").append(i->first);
+  }
+  if (is_ambiguous)
+    throw std::logic_error{std::string{"ambiguous command \""}.append(name)
+      .append("\" (candidates: ").append(candidates).append(")")};
+  return result;
+}
+
+DMITIGR_INTERNAL_INLINE std::optional<std::string_view> Command_registry::resolve(const std::string_view name) const
+{
+  const auto index = command_index(name);
+  return index ? std::make_optional(commands_[*index].name) : std::nullopt;
+}
+
+DMITIGR_INTERNAL_INLINE std::unique_ptr<Command> Command_registry::make(const std::string_view name,
+  const Arguments arguments) const
+{
+  if (const auto index = command_index(name))
+    return commands_[*index].factory(arguments);
+  else
+    throw std::logic_error{std::string{"unknown command \""}.append(name).append("\"")};
+}
+
+DMITIGR_INTERNAL_INLINE std::unique_ptr<Command> Command_registry::make(const Arguments arguments) const
+{
+  if (arguments.empty())
+    throw std::logic_error{"no command specified"};
+  return make(arguments[0], arguments.suffix(1));
+}
+
+DMITIGR_INTERNAL_INLINE std::vector<std::string_view> Command_registry::names() const
+{
+  std::vector<std::string_view> result;
+  result.reserve(commands_.size());
+  for (const auto& command : commands_)
+    result.push_back(command.name);
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+// -----------------------------------------------------------------------------
+// Profiling
+// -----------------------------------------------------------------------------
+
+namespace {
+
+/**
+ * @internal
+ *
+ * Appends `str` quoted as the JSON string to `output`.
+ */
+inline void print_json_string__(std::ostream& output, const std::string_view str)
+{
+  output << '"';
+  for (const char c : str) {
+    if (c == '"' || c == '\\')
+      output << '\\' << c;
+    else if (static_cast<unsigned char>(c) < 0x20)
+      output << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c)
+             << std::dec << std::setfill(' ');
+    else
+      output << c;
+  }
+  output << '"';
+}
+
+/**
+ * @internal
+ *
+ * @returns The `time` in milliseconds.
+ */
+inline double milliseconds__(const std::chrono::nanoseconds time) noexcept
+{
+  return std::chrono::duration<double, std::milli>{time}.count();
+}
+
+/**
+ * @internal
+ *
+ * @brief Represents the CPU times of the thread and of the process.
+ */
+struct Cpu_times final {
+  std::chrono::nanoseconds thread_time{};
+  std::chrono::nanoseconds user_time{};
+  std::chrono::nanoseconds system_time{};
+};
+
+/**
+ * @returns The CPU times. Unlike `os::resource_usage()` doesn't read files,
+ * so the profiler doesn't bill its own I/O to the command.
+ */
+inline Cpu_times cpu_times__()
+{
+  Cpu_times result;
+#ifdef _WIN32
+  const auto usage = os::resource_usage();
+  result.thread_time = usage.thread_time;
+  result.user_time = usage.user_time;
+  result.system_time = usage.system_time;
+#else
+  using std::chrono::seconds;
+  using std::chrono::microseconds;
+  using std::chrono::nanoseconds;
+  ::timespec ts{};
+  if (::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+    result.thread_time = seconds{ts.tv_sec} + nanoseconds{ts.tv_nsec};
+  ::rusage ru{};
+  if (::getrusage(RUSAGE_SELF, &ru) == 0) {
+    result.user_time = seconds{ru.ru_utime.tv_sec} + microseconds{ru.ru_utime.tv_usec};
+    result.system_time = seconds{ru.ru_stime.tv_sec} + microseconds{ru.ru_stime.tv_usec};
+  }
+#endif
+  return result;
+}
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE std::string to_string(const Profile& profile, const Profile_format format)
+{
+  std::ostringstream result;
+  result << std::fixed << std::setprecision(3);
+  if (format == Profile_format::json) {
+    result << "{\"command\":";
+    print_json_string__(result, profile.command);
+    result << ",\"wall_time_ms\":" << milliseconds__(profile.wall_time)
+           << ",\"thread_time_ms\":" << milliseconds__(profile.thread_time)
+           << ",\"user_time_ms\":" << milliseconds__(profile.user_time)
+           << ",\"system_time_ms\":" << milliseconds__(profile.system_time)
+           << ",\"peak_resident_size\":" << profile.peak_resident_size;
+    if (profile.allocation_count)
+      result << ",\"allocation_count\":" << *profile.allocation_count
+             << ",\"allocation_size\":" << *profile.allocation_size;
+    result << ",\"phases\":[";
+    for (const auto& phase : profile.phases) {
+      result << (&phase != profile.phases.data() ? ",{\"name\":" : "{\"name\":");
+      print_json_string__(result, phase.name);
+      result << ",\"time_ms\":" << milliseconds__(phase.time)
+             << ",\"count\":" << phase.count << '}';
+    }
+    result << "]}\n";
+  } else {
+    result << "profile of the \"" << profile.command << "\" command:\n"
+           << "  wall time: " << milliseconds__(profile.wall_time) << " ms\n"
+           << "  cpu time: " << milliseconds__(profile.thread_time) << " ms"
+           << " (process user " << milliseconds__(profile.user_time) << " ms"
+           << ", system " << milliseconds__(profile.system_time) << " ms)\n"
+           << "  peak rss: " << profile.peak_resident_size / 1024 << " KiB\n";
+    if (profile.allocation_count)
+      result << "  allocations: " << *profile.allocation_count
+             << " (" << *profile.allocation_size << " bytes)\n";
+    for (const auto& phase : profile.phases)
+      result << "  phase \"" << phase.name << "\": " << milliseconds__(phase.time)
+             << " ms (" << phase.count << (phase.count == 1 ? " time)\n" : " times)\n");
+  }
+  return result.str();
+}
+
+DMITIGR_INTERNAL_INLINE Profiler::Profiler(std::string command)
+  : previous_{current_}
+{
+  profile_.command = std::move(command);
+  profile_.phases.reserve(16);
+  // The wall clock is started first and the CPU times are sampled last.
+  start_time_ = std::chrono::steady_clock::now();
+  allocations_ = detail::allocation_counter__;
+  const auto times = cpu_times__();
+  thread_time_ = times.thread_time;
+  user_time_ = times.user_time;
+  system_time_ = times.system_time;
+  current_ = this;
+}
+
+DMITIGR_INTERNAL_INLINE Profiler::~Profiler()
+{
+  current_ = previous_;
+}
+
+DMITIGR_INTERNAL_INLINE void Profiler::add_phase(const std::string_view name,
+  const std::chrono::nanoseconds time) noexcept
+{
+  auto& phases = profile_.phases;
+  const auto i = std::find_if(phases.begin(), phases.end(),
+    [name](const auto& phase) { return phase.name == name; });
+  try {
+    auto& phase = i != phases.end() ? *i : phases.emplace_back(Profile::Phase{std::string{name}});
+    phase.time += time;
+    ++phase.count;
+  } catch (...) {} // the phase is not accounted if there is no memory
+}
+
+DMITIGR_INTERNAL_INLINE Profile Profiler::profile() const
+{
+  // The CPU times are sampled first and the wall clock is stopped last.
+  const auto times = cpu_times__();
+  const auto allocations = detail::allocation_counter__;
+  const auto wall_time = std::chrono::steady_clock::now() - start_time_;
+
+  Profile result{profile_};
+  result.wall_time = wall_time;
+  result.thread_time = times.thread_time - thread_time_;
+  result.user_time = times.user_time - user_time_;
+  result.system_time = times.system_time - system_time_;
+  result.peak_resident_size = os::resource_usage().peak_resident_size;
+  if (detail::is_allocation_counted__.load()) {
+    result.allocation_count = allocations.count - allocations_.count;
+    result.allocation_size = allocations.size - allocations_.size;
+  }
+  return result;
+}
+
+DMITIGR_INTERNAL_INLINE void run_command(const Command_registry& registry, Arguments arguments,
+  std::ostream& output, std::ostream& report_output)
+{
+  constexpr std::string_view profile_option{"--profile"};
+  std::optional<Profile_format> format;
+  if (!arguments.empty() && arguments[0].compare(0, profile_option.size(), profile_option) == 0) {
+    const auto value = arguments[0].substr(profile_option.size());
+    if (value.empty() || value == "=text")
+      format = Profile_format::text;
+    else if (value == "=json")
+      format = Profile_format::json;
+    else
+      throw std::logic_error{std::string{"invalid global option \""}.append(arguments[0]).append("\"")};
+    arguments = arguments.suffix(1);
+  }
+
+  if (!format) {
+    const auto command = registry.make(arguments);
+    command->set_output(output);
+    command->run();
+    return;
+  }
+
+  // The construction of the command (i.e. the parsing of options) is profiled too.
+  Profiler profiler{arguments.empty() ? std::string{} :
+    std::string{registry.resolve(arguments[0]).value_or(arguments[0])}};
+  try {
+    const auto command = registry.make(arguments);
+    command->set_output(output);
+    command->run();
+  } catch (...) {
+    report_output << to_string(profiler.profile(), *format);
+    throw;
+  }
+  report_output << to_string(profiler.profile(), *format);
+}
+
+// -----------------------------------------------------------------------------
+// Batch_runner
+// -----------------------------------------------------------------------------
+
+namespace {
+
+/**
+ * @internal
+ *
+ * @returns The arguments of the command `line`.
+ */
+inline std::vector<std::string> split_command_line__(const std::string& line)
+{
+  std::vector<std::string> result;
+  std::istringstream input{line};
+  while (true) {
+    auto phrase = stream::read_simple_phrase_to_string(input);
+    if (phrase.empty() && !input)
+      break;
+    result.push_back(std::move(phrase));
+  }
+  return result;
+}
+
+inline bool is_blank__(const std::string& line) noexcept
+{
+  return std::all_of(line.cbegin(), line.cend(),
+    [](const unsigned char c) { return std::isspace(c); });
+}
+
+#ifndef _WIN32
+/**
+ * @internal
+ *
+ * The stream buffer of the socket.
+ */
+class Socket_streambuf__ final : public std::streambuf {
+public:
+  explicit Socket_streambuf__(const int socket) noexcept
+    : socket_{socket}
+  {
+    setg(input_, input_, input_);
+    setp(output_, output_ + sizeof(output_));
+  }
+
+protected:
+  int_type underflow() override
+  {
+    ssize_t count;
+    do {
+      count = ::read(socket_, input_, sizeof(input_));
+    } while (count < 0 && errno == EINTR);
+    if (count <= 0)
+      return traits_type::eof();
+    setg(input_, input_, input_ + count);
+    return traits_type::to_int_type(*gptr());
+  }
+
+  int_type overflow(const int_type ch) override
+  {
+    if (!flush())
+      return traits_type::eof();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(ch);
+      pbump(1);
+    }
+    return traits_type::not_eof(ch);
+  }
+
+  int sync() override
+  {
+    return flush() ? 0 : -1;
+  }
+
+private:
+  int socket_{-1};
+  char input_[4096];
+  char output_[4096];
+
+  bool flush() noexcept
+  {
+#ifdef MSG_NOSIGNAL
+    constexpr int flags{MSG_NOSIGNAL};
+#else
+    constexpr int flags{};
+#endif
+    for (const char* data = pbase(); data < pptr();) {
+      const auto count = ::send(socket_, data, pptr() - data, flags);
+      if (count < 0 && errno == EINTR)
+        continue;
+      else if (count <= 0)
+        return false;
+      data += count;
+    }
+    setp(output_, output_ + sizeof(output_));
+    return true;
+  }
+};
+#endif
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE auto Batch_runner::execute(const std::string& line) const -> Result
+{
+  std::vector<std::string> arguments;
+  try {
+    arguments = split_command_line__(line);
+  } catch (const stream::Read_exception&) {
+    // The only possible error of reading from the string is the missing quote.
+    return Result{exit_usage, "invalid command line: unterminated quoted argument\n"};
+  }
+  const std::vector<std::string_view> views(arguments.cbegin(), arguments.cend());
+  return execute(Arguments{views});
+}
+
+DMITIGR_INTERNAL_INLINE auto Batch_runner::execute(const Arguments arguments) const -> Result
+{
+  Result result;
+  std::ostringstream output;
+  try {
+    run_command(registry_, arguments, output, output);
+    result.exit_status = exit_success;
+  } catch (const std::logic_error& e) {
+    output << e.what() << '\n';
+    result.exit_status = exit_usage;
+  } catch (const std::exception& e) {
+    output << e.what() << '\n';
+    result.exit_status = exit_failure;
+  } catch (...) {
+    output << "unknown error\n";
+    result.exit_status = exit_failure;
+  }
+  result.output = output.str();
+  return result;
+}
+
+/**
+ * @internal
+ *
+ * @brief Represents the bounded pool of threads running the jobs in FIFO order.
+ */
+class Batch_runner::Worker_pool final {
+public:
+  explicit Worker_pool(const std::size_t size)
+  {
+    threads_.reserve(size);
+    for (std::size_t i = 0; i < size; ++i) {
+      try {
+        threads_.emplace_back([this]{ work(); });
+      } catch (const std::system_error&) {
+        break; // the threads already started will do the work
+      }
+    }
+  }
+
+  ~Worker_pool()
+  {
+    {
+      const std::lock_guard lg{mutex_};
+      is_stopped_ = true;
+    }
+    job_posted_.notify_all();
+    for (auto& thread : threads_)
+      thread.join();
+  }
+
+  std::size_t size() const noexcept
+  {
+    return threads_.size();
+  }
+
+  /**
+   * @brief Posts the `job` to run.
+   *
+   * @par Requires
+   * `job` must not throw.
+   */
+  void post(std::function<void()> job)
+  {
+    {
+      const std::lock_guard lg{mutex_};
+      jobs_.push_back(std::move(job));
+    }
+    job_posted_.notify_one();
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable job_posted_;
+  std::deque<std::function<void()>> jobs_;
+  bool is_stopped_{};
+  std::vector<std::thread> threads_;
+
+  void work()
+  {
+    while (true) {
+      std::unique_lock lk{mutex_};
+      job_posted_.wait(lk, [this]{ return !jobs_.empty() || is_stopped_; });
+      if (jobs_.empty())
+        return;
+      const auto job = std::move(jobs_.front());
+      jobs_.pop_front();
+      lk.unlock();
+      job();
+    }
+  }
+};
+
+DMITIGR_INTERNAL_INLINE Batch_runner::~Batch_runner() = default;
+
+DMITIGR_INTERNAL_INLINE auto Batch_runner::worker_pool() const -> Worker_pool*
+{
+  std::call_once(worker_pool_once_, [this]
+  {
+    if (const auto size = concurrency::thread_count(std::numeric_limits<std::size_t>::max(), concurrency_); size > 1)
+      worker_pool_.reset(new Worker_pool{size});
+  });
+  return worker_pool_ && worker_pool_->size() ? worker_pool_.get() : nullptr;
+}
+
+DMITIGR_INTERNAL_INLINE void Batch_runner::run(std::istream& input, std::ostream& output) const
+{
+  const auto write_frame = [&output](const std::size_t number, const Result& result)
+  {
+    output << number << ' ' << result.exit_status << ' ' << result.output.size() << '\n';
+    output.write(result.output.data(), result.output.size());
+    output.flush();
+  };
+
+  const auto pool = worker_pool();
+  if (!pool) {
+    std::string line;
+    for (std::size_t number = 1; std::getline(input, line); ++number) {
+      if (!is_blank__(line))
+        write_frame(number, execute(line));
+    }
+    return;
+  }
+
+  /*
+   * The input is read by the reader thread, which posts the commands to the
+   * shared pool. The workers only queue the results, which are written by
+   * this thread, so the blocked output (e.g. of the client which doesn't read
+   * the frames) doesn't occupy the workers. The number of the commands of
+   * this input in flight or with unwritten results is bounded, so the whole
+   * input isn't read ahead.
+   */
+  struct Completion final {
+    std::size_t number{};
+    Result result;
+  };
+  std::mutex mutex;
+  std::condition_variable state_changed;
+  std::deque<Completion> completions;
+  std::size_t in_flight_count{};
+  bool is_input_done{};
+  std::exception_ptr input_error;
+  const auto in_flight_limit = 2 * pool->size();
+  std::thread reader{[this, &input, &mutex, &state_changed, &completions, &in_flight_count,
+      &is_input_done, &input_error, pool, in_flight_limit]
+  {
+    try {
+      std::string line;
+      for (std::size_t number = 1; std::getline(input, line); ++number) {
+        if (is_blank__(line))
+          continue;
+
+        {
+          std::unique_lock lk{mutex};
+          state_changed.wait(lk, [&]{ return in_flight_count < in_flight_limit; });
+          ++in_flight_count;
+        }
+        try {
+          pool->post([this, &mutex, &state_changed, &completions, &in_flight_count,
+              number, line = std::move(line)]
+          {
+            std::optional<Result> result;
+            try {
+              result = execute(line);
+            } catch (...) {} // the frame is lost if there is no memory
+            // Notify under the lock since the waiter destroys the condition upon return.
+            const std::lock_guard lg{mutex};
+            if (result) {
+              try {
+                completions.push_back(Completion{number, std::move(*result)});
+              } catch (...) {
+                result.reset();
+              }
+            }
+            if (!result)
+              --in_flight_count;
+            state_changed.notify_all();
+          });
+        } catch (...) {
+          const std::lock_guard lg{mutex};
+          --in_flight_count;
+          throw;
+        }
+      }
+    } catch (...) {
+      input_error = std::current_exception();
+    }
+    const std::lock_guard lg{mutex};
+    is_input_done = true;
+    state_changed.notify_all();
+  }};
+
+  std::unique_lock lk{mutex};
+  while (true) {
+    state_changed.wait(lk, [&]{ return !completions.empty() || (is_input_done && !in_flight_count); });
+    if (completions.empty())
+      break;
+
+    auto completion = std::move(completions.front());
+    completions.pop_front();
+    lk.unlock();
+    try {
+      write_frame(completion.number, completion.result);
+    } catch (...) {} // the frame is lost if the output failed
+    lk.lock();
+    --in_flight_count;
+    state_changed.notify_all();
+  }
+  lk.unlock();
+  reader.join();
+  if (input_error)
+    std::rethrow_exception(input_error);
+}
+
+#ifndef _WIN32
+DMITIGR_INTERNAL_INLINE void Batch_runner::serve(const std::filesystem::path& path)
+{
+  const auto throw_error = [](const int code)
+  {
+    throw std::system_error{code, std::system_category(),
+      "dmitigr::internal::console::Batch_runner::serve()"};
+  };
+
+  {
+    const std::lock_guard lg{sockets_mutex_};
+    is_stopped_ = false;
+  }
+
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.native().size() >= sizeof(address.sun_path))
+    throw_error(ENAMETOOLONG);
+  std::memcpy(address.sun_path, path.c_str(), path.native().size() + 1);
+
+  const int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0)
+    throw_error(errno);
+  if (std::error_code ec; is_socket(std::filesystem::symlink_status(path, ec)))
+    std::filesystem::remove(path, ec);
+  if (::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) ||
+    ::listen(listener, SOMAXCONN)) {
+    const int code = errno;
+    ::close(listener);
+    throw_error(code);
+  }
+
+  struct Session final {
+    std::thread thread;
+    std::atomic<bool> is_done{};
+  };
+  std::list<Session> sessions;
+  const auto close_socket = [this](const int socket)
+  {
+    {
+      const std::lock_guard lg{sockets_mutex_};
+      sockets_.erase(std::find(sockets_.begin(), sockets_.end(), socket));
+    }
+    ::close(socket);
+  };
+  const auto finish = [&]
+  {
+    stop();
+    for (auto& session : sessions)
+      session.thread.join();
+    close_socket(listener);
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+  };
+  {
+    const std::lock_guard lg{sockets_mutex_};
+    sockets_.push_back(listener);
+  }
+
+  while (!is_stopped_.load()) {
+    const int connection = ::accept(listener, nullptr, nullptr);
+    if (connection < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      else if (is_stopped_.load())
+        break;
+      const int code = errno;
+      finish();
+      throw_error(code);
+    }
+
+    // Join the completed sessions.
+    sessions.remove_if([](Session& session)
+    {
+      const bool result = session.is_done.load();
+      if (result)
+        session.thread.join();
+      return result;
+    });
+
+    {
+      const std::lock_guard lg{sockets_mutex_};
+      if (is_stopped_.load()) {
+        ::close(connection);
+        break;
+      }
+      sockets_.push_back(connection);
+    }
+    auto& session = sessions.emplace_back();
+    try {
+      session.thread = std::thread{[this, connection, &close_socket, &is_done = session.is_done]
+      {
+        try {
+          Socket_streambuf__ buffer{connection};
+          std::istream input{&buffer};
+          std::ostream output{&buffer};
+          run(input, output);
+        } catch (...) {}
+        close_socket(connection);
+        is_done = true;
+      }};
+    } catch (...) {
+      sessions.pop_back();
+      close_socket(connection);
+      finish();
+      throw;
+    }
+  }
+  finish();
+}
+
+DMITIGR_INTERNAL_INLINE void Batch_runner::stop() noexcept
+{
+  const std::lock_guard lg{sockets_mutex_};
+  is_stopped_ = true;
+  for (const int socket : sockets_)
+    ::shutdown(socket, SHUT_RDWR);
+}
+#endif
+
 DMITIGR_INTERNAL_INLINE std::pair<std::string, std::vector<std::string>> command_and_options(const int argc, const char* const* argv)
 {
   DMITIGR_INTERNAL_ASSERT(argc > 1);
@@ -5,16 +5,458 @@
 #ifndef DMITIGR_INTERNAL_CONSOLE_HPP
 #define DMITIGR_INTERNAL_CONSOLE_HPP
 
+#include "dmitigr/internal/debug.hpp"
 #include "dmitigr/internal/dll.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
 #include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 namespace dmitigr::internal::console {
 
+/**
+ * @internal
+ *
+ * @brief Denotes whether the option accepts an argument.
+ */
+enum class Option_arity {
+  /** The option doesn't accept an argument: `--name`. */
+  none,
+
+  /** The option accepts an optional argument: `--name[=value]`. */
+  optional,
+
+  /** The option requires an argument: `--name=value`. */
+  required
+};
+
+/**
+ * @internal
+ *
+ * @brief Denotes the type of the option argument.
+ */
+enum class Option_type {
+  /** The values are: "y", "yes", "t", "true", "1", "n", "no", "f", "false", "0". */
+  boolean,
+
+  /** The value is a decimal `std::int64_t`. */
+  integer,
+
+  /** The value is a `double`. */
+  floating,
+
+  /** The value is a `std::string_view` to the part of the argument. */
+  string
+};
+
+namespace detail {
+
+/**
+ * @internal
+ *
+ * Converts `value` to the `field` of the `type`, or throws `std::logic_error`.
+ */
+DMITIGR_INTERNAL_API void parse_option_value__(std::string_view option, Option_type type,
+  std::string_view value, void* field);
+
+/**
+ * @internal
+ *
+ * @returns The name of the `type` in the usage text.
+ */
+DMITIGR_INTERNAL_API std::string_view option_type_name__(Option_type type) noexcept;
+
+[[noreturn]] DMITIGR_INTERNAL_API void throw_option_error__(std::string_view details,
+  std::string_view option);
+
+/**
+ * @internal
+ *
+ * @returns The hash of `str` with the `seed` suitable for the constant evaluation.
+ */
+constexpr std::uint64_t option_hash__(const std::string_view str, const std::uint64_t seed) noexcept
+{
+  std::uint64_t result = 14695981039346656037ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+  for (const char c : str) {
+    result ^= static_cast<unsigned char>(c);
+    result *= 1099511628211ULL;
+  }
+  return result ^ (result >> 29);
+}
+
+/**
+ * @internal
+ *
+ * @returns The smallest power of two which is greater or equal to `n`.
+ */
+constexpr std::size_t ceil_pow2__(const std::size_t n) noexcept
+{
+  std::size_t result = 1;
+  while (result < n)
+    result <<= 1;
+  return result;
+}
+
+} // namespace detail
+
+/**
+ * @internal
+ *
+ * @brief Represents a declaration of the option of the `Options` structure.
+ *
+ * @details The type of the option is deduced from the type of its field.
+ */
+template<class Options>
+class Option final {
+public:
+  /** Constructs the flag `--name`, which sets the `field` to `true`. */
+  constexpr Option(const std::string_view name, bool Options::* const field,
+    const std::string_view description)
+    : Option{name, Option_type::boolean, Option_arity::none, "false", description}
+  {
+    boolean_ = field;
+  }
+
+  /** Constructs the boolean option. `--name` implies `true`. */
+  constexpr Option(const std::string_view name, bool Options::* const field,
+    const Option_arity arity, const std::string_view default_value,
+    const std::string_view description)
+    : Option{name, Option_type::boolean, arity, default_value, description}
+  {
+    boolean_ = field;
+  }
+
+  /** Constructs the integer option. */
+  constexpr Option(const std::string_view name, std::int64_t Options::* const field,
+    const Option_arity arity, const std::string_view default_value,
+    const std::string_view description)
+    : Option{name, Option_type::integer, arity, default_value, description}
+  {
+    integer_ = field;
+  }
+
+  /** Constructs the floating point option. */
+  constexpr Option(const std::string_view name, double Options::* const field,
+    const Option_arity arity, const std::string_view default_value,
+    const std::string_view description)
+    : Option{name, Option_type::floating, arity, default_value, description}
+  {
+    floating_ = field;
+  }
+
+  /**
+   * @brief Constructs the string option.
+   *
+   * @remarks The value refers to the parsed argument, so the latter must
+   * outlive the `Options`.
+   */
+  constexpr Option(const std::string_view name, std::string_view Options::* const field,
+    const Option_arity arity, const std::string_view default_value,
+    const std::string_view description)
+    : Option{name, Option_type::string, arity, default_value, description}
+  {
+    string_ = field;
+  }
+
+  /** @returns The name of the option without the leading "--". */
+  constexpr std::string_view name() const noexcept
+  {
+    return name_;
+  }
+
+  /** @returns The type of the option argument. */
+  constexpr Option_type type() const noexcept
+  {
+    return type_;
+  }
+
+  /** @returns The arity of the option. */
+  constexpr Option_arity arity() const noexcept
+  {
+    return arity_;
+  }
+
+  /**
+   * @returns The value assigned before the parsing, and in case of the omitted
+   * optional argument of non-boolean option. (Empty default means that the
+   * field is not touched.)
+   */
+  constexpr std::string_view default_value() const noexcept
+  {
+    return default_value_;
+  }
+
+  /** @returns The description of the option. */
+  constexpr std::string_view description() const noexcept
+  {
+    return description_;
+  }
+
+  /** Assigns the `value` to the field of `options`. */
+  void assign(Options& options, const std::string_view value) const
+  {
+    detail::parse_option_value__(name_, type_, value, field(options));
+  }
+
+  /** Assigns the value implied by the option without an argument. */
+  void assign_implicit(Options& options) const
+  {
+    if (type_ == Option_type::boolean)
+      options.*boolean_ = true;
+    else if (!default_value_.empty())
+      assign(options, default_value_);
+  }
+
+private:
+  std::string_view name_;
+  Option_type type_;
+  Option_arity arity_;
+  std::string_view default_value_;
+  std::string_view description_;
+  bool Options::* boolean_{};
+  std::int64_t Options::* integer_{};
+  double Options::* floating_{};
+  std::string_view Options::* string_{};
+
+  constexpr Option(const std::string_view name, const Option_type type,
+    const Option_arity arity, const std::string_view default_value,
+    const std::string_view description)
+    : name_{name}
+    , type_{type}
+    , arity_{arity}
+    , default_value_{default_value}
+    , description_{description}
+  {
+    if (name_.empty() || name_[0] == '-' || name_.find('=') != std::string_view::npos)
+      throw std::logic_error{"invalid option name"};
+    else if (arity_ == Option_arity::none && type_ != Option_type::boolean)
+      throw std::logic_error{"only the boolean option can have no argument"};
+  }
+
+  void* field(Options& options) const noexcept
+  {
+    switch (type_) {
+    case Option_type::boolean: return &(options.*boolean_);
+    case Option_type::integer: return &(options.*integer_);
+    case Option_type::floating: return &(options.*floating_);
+    case Option_type::string: return &(options.*string_);
+    }
+    return nullptr;
+  }
+};
+
+/**
+ * @internal
+ *
+ * @brief Represents a table of options of the `Options` structure.
+ *
+ * @details The table is intended to be defined as `constexpr`, for example:
+ * @code
+ * struct Exec_options {
+ *   bool is_strong{};
+ *   std::int64_t jobs{};
+ *   std::string_view host;
+ * };
+ *
+ * static constexpr auto exec_options = make_option_table<Exec_options>({
+ *   {"strong", &Exec_options::is_strong, "Stop on the first error"},
+ *   {"jobs", &Exec_options::jobs, Option_arity::required, "1", "The number of jobs"},
+ *   {"host", &Exec_options::host, Option_arity::required, "localhost", "The host"}});
+ * @endcode
+ * The names of the options are dispatched by the perfect hash computed during
+ * the constant evaluation, so the lookup of the option costs one hash of its
+ * name and one comparison.
+ */
+template<class Options, std::size_t N>
+class Option_table final {
+  static_assert(0 < N && N < 256);
+public:
+  /** The alias of the option. */
+  using Option = console::Option<Options>;
+
+  /** Represents a set of options specified in the parsed arguments. */
+  using Presence = std::bitset<N>;
+
+  /**
+   * @brief The constructor.
+   *
+   * @throws `std::logic_error` (which is a compile-time error during the
+   * constant evaluation) if there are duplicate names of options.
+   */
+  constexpr explicit Option_table(const Option(&options)[N])
+    : Option_table{options, std::make_index_sequence<N>{}}
+  {}
+
+  /** @returns The number of options. */
+  constexpr std::size_t size() const noexcept
+  {
+    return N;
+  }
+
+  /** @returns The option at `index`. */
+  constexpr const Option& operator[](const std::size_t index) const noexcept
+  {
+    return options_[index];
+  }
+
+  /** @returns The index of the option `name` (without the leading "--"). */
+  constexpr std::optional<std::size_t> index(const std::string_view name) const noexcept
+  {
+    const auto slot = slots_[detail::option_hash__(name, seed_) & (slot_count_ - 1)];
+    return slot && options_[slot - 1].name() == name ?
+      std::make_optional<std::size_t>(slot - 1) : std::nullopt;
+  }
+
+  /**
+   * @brief Assigns the default values and then parses the options from the
+   * range [i, e) into the `options`.
+   *
+   * @details The parsing stops at the first argument which is not started
+   * with "--", or at the "--" argument.
+   *
+   * @param presence - The set to mark the specified options in, or `nullptr`.
+   *
+   * @returns The iterator to the first argument which is not an option.
+   *
+   * @throws `std::logic_error` on invalid usage.
+   */
+  template<class Iterator>
+  Iterator parse(Iterator i, const Iterator e, Options& options,
+    Presence* const presence = nullptr) const
+  {
+    for (const auto& option : options_) {
+      if (!option.default_value().empty())
+        option.assign(options, option.default_value());
+    }
+    if (presence)
+      presence->reset();
+
+    for (; i != e; ++i) {
+      const std::string_view argument{*i};
+      if (argument.size() <= 2 || argument[0] != '-' || argument[1] != '-')
+        break;
+
+      const auto body = argument.substr(2);
+      const auto eq_pos = body.find('=');
+      const auto name = body.substr(0, eq_pos);
+      const auto idx = index(name);
+      if (!idx)
+        detail::throw_option_error__("unknown option", name);
+
+      const auto& option = options_[*idx];
+      if (eq_pos == std::string_view::npos) {
+        if (option.arity() == Option_arity::required)
+          detail::throw_option_error__("no argument specified for the option", name);
+        option.assign_implicit(options);
+      } else {
+        if (option.arity() == Option_arity::none)
+          detail::throw_option_error__("no argument can be specified for the option", name);
+        option.assign(options, body.substr(eq_pos + 1));
+      }
+      if (presence)
+        presence->set(*idx);
+    }
+    return i;
+  }
+
+  /**
+   * @returns The usage text of options, one option per line in the format:
+   * `  --name=<type>  description (default: value)`.
+   */
+  std::string usage() const
+  {
+    const auto argument = [](const Option& option)
+    {
+      std::string result{"--"};
+      result.append(option.name());
+      const auto type = detail::option_type_name__(option.type());
+      if (option.arity() == Option_arity::required)
+        result.append("=<").append(type).append(">");
+      else if (option.arity() == Option_arity::optional)
+        result.append("[=<").append(type).append(">]");
+      return result;
+    };
+
+    std::size_t width{};
+    for (const auto& option : options_)
+      width = std::max(width, argument(option).size());
+
+    std::string result;
+    for (const auto& option : options_) {
+      auto arg = argument(option);
+      arg.resize(width, ' ');
+      result.append("  ").append(arg).append("  ").append(option.description());
+      if (option.arity() != Option_arity::none && !option.default_value().empty())
+        result.append(" (default: ").append(option.default_value()).append(")");
+      result.append("\n");
+    }
+    return result;
+  }
+
+private:
+  static constexpr std::size_t slot_count_ = detail::ceil_pow2__(4 * N);
+  std::array<Option, N> options_;
+  std::array<std::uint8_t, slot_count_> slots_{}; // index + 1, or 0 if empty
+  std::uint64_t seed_{};
+
+  template<std::size_t ... I>
+  constexpr Option_table(const Option(&options)[N], std::index_sequence<I...>)
+    : options_{options[I]...}
+  {
+    for (std::size_t i = 0; i < N; ++i) {
+      for (std::size_t j = i + 1; j < N; ++j) {
+        if (options_[i].name() == options_[j].name())
+          throw std::logic_error{"duplicate option name"};
+      }
+    }
+
+    // Search the seed that gives no collisions.
+    for (;; ++seed_) {
+      slots_ = {};
+      std::size_t i{};
+      for (; i < N; ++i) {
+        auto& slot = slots_[detail::option_hash__(options_[i].name(), seed_) & (slot_count_ - 1)];
+        if (slot)
+          break;
+        slot = static_cast<std::uint8_t>(i + 1);
+      }
+      if (i == N)
+        break;
+    }
+  }
+};
+
+/**
+ * @returns The table of `options`.
+ *
+ * @see Option_table.
+ */
+template<class Options, std::size_t N>
+constexpr Option_table<Options, N> make_option_table(const Option<Options>(&options)[N])
+{
+  return Option_table<Options, N>{options};
+}
+
 /**
  * @internal
  *
@@ -34,7 +476,23 @@ public:
   /** Runs the command. */
   virtual void run() = 0;
 
+  /**
+   * @brief Sets the output stream of the command.
+   *
+   * @remarks The `output` must outlive the instance.
+   */
+  void set_output(std::ostream& output) noexcept
+  {
+    output_ = &output;
+  }
+
 protected:
+  /** @returns The output stream of the command (`std::cout` by default). */
+  std::ostream& output() const noexcept
+  {
+    return *output_;
+  }
+
   /** Represents a vector of command options. */
   using Option_vector = std::vector<std::string>;
 
@@ -70,6 +528,609 @@ protected:
    * The parser must accepts one argument: the string of the option to parse.
    */
   DMITIGR_INTERNAL_API Option_iterator parse_options(Option_iterator i, const Option_iterator e, Option_parser parse_option);
+
+  /**
+   * @brief Parses the options by using the `table`.
+   *
+   * @returns The iterator to the first argument which is not an option.
+   *
+   * @throws An instance of std::logic_error with the usage of the command
+   * on invalid usage.
+   *
+   * @see Option_table::parse().
+   */
+  template<class Iterator, class Options, std::size_t N>
+  Iterator parse_options(const Iterator i, const Iterator e,
+    const Option_table<Options, N>& table, Options& options,
+    typename Option_table<Options, N>::Presence* const presence = nullptr) const
+  {
+    try {
+      return table.parse(i, e, options, presence);
+    } catch (const std::logic_error& error) {
+      throw_invalid_usage(error.what());
+    }
+  }
+
+private:
+  std::ostream* output_{&std::cout};
+};
+
+/**
+ * @internal
+ *
+ * @brief Represents a non-owning view of the command arguments.
+ *
+ * @remarks The viewed arguments must outlive the instance.
+ */
+class Arguments final {
+public:
+  /** Represents an iterator of arguments. */
+  using Iterator = const std::string_view*;
+
+  /** Constructs the empty view. */
+  Arguments() noexcept = default;
+
+  /** Constructs the view of `size` arguments starting at `data`. */
+  Arguments(const std::string_view* const data, const std::size_t size) noexcept
+    : data_{data}
+    , size_{size}
+  {}
+
+  /** Constructs the view of `arguments`. */
+  Arguments(const std::vector<std::string_view>& arguments) noexcept
+    : Arguments{arguments.data(), arguments.size()}
+  {}
+
+  /** Disallows the view of the temporary. */
+  Arguments(std::vector<std::string_view>&&) = delete;
+
+  /** @returns The iterator to the first argument. */
+  Iterator begin() const noexcept
+  {
+    return data_;
+  }
+
+  /** @returns The iterator following the last argument. */
+  Iterator end() const noexcept
+  {
+    return data_ + size_;
+  }
+
+  /** @returns The number of arguments. */
+  std::size_t size() const noexcept
+  {
+    return size_;
+  }
+
+  /** @returns `(size() == 0)`. */
+  bool empty() const noexcept
+  {
+    return !size_;
+  }
+
+  /**
+   * @returns The argument at `index`.
+   *
+   * @par Requires
+   * `(index < size())`.
+   */
+  std::string_view operator[](const std::size_t index) const
+  {
+    DMITIGR_INTERNAL_ASSERT(index < size_);
+    return data_[index];
+  }
+
+  /** @returns The view of arguments without the first `count` ones. */
+  Arguments suffix(const std::size_t count) const noexcept
+  {
+    const auto offset = std::min(count, size_);
+    return Arguments{data_ + offset, size_ - offset};
+  }
+
+private:
+  const std::string_view* data_{};
+  std::size_t size_{};
+};
+
+/**
+ * @returns The views of `argv[1]`, ..., `argv[argc - 1]` (no strings are copied).
+ *
+ * @par Requires
+ * `(argc > 0 && argv)`.
+ */
+DMITIGR_INTERNAL_API std::vector<std::string_view> argument_views(int argc, const char* const* argv);
+
+/**
+ * @internal
+ *
+ * @brief Represents a registry of commands.
+ *
+ * @details The commands are constructed only when selected. The name of the
+ * command can be specified by its name, by its alias or by the prefix of
+ * either one which is unambiguous, for example:
+ * @code
+ * Command_registry registry;
+ * registry.add<Exec_command>("exec", {"x"});
+ * registry.add<Help_command>("help");
+ * const auto arguments = argument_views(argc, argv);
+ * registry.make(arguments)->run(); // "exec", "x", "ex", "he" are all valid
+ * @endcode
+ *
+ * @remarks The method `add()` must not be called concurrently with any other
+ * method. The constant methods are thread-safe.
+ */
+class Command_registry final {
+public:
+  /** Constructs the empty registry. */
+  Command_registry() = default;
+
+  /**
+   * Non copyable, since the indexes refer to the names stored in the
+   * instance.
+   */
+  Command_registry(const Command_registry&) = delete;
+
+  /** Non copyable. */
+  Command_registry& operator=(const Command_registry&) = delete;
+
+  /** The move constructor. (The stored names are not relocated.) */
+  Command_registry(Command_registry&&) = default;
+
+  /** The move assignment operator. */
+  Command_registry& operator=(Command_registry&&) = default;
+
+  /**
+   * @brief Represents a factory of commands.
+   *
+   * The factory accepts the arguments following the command name.
+   */
+  using Factory = std::function<std::unique_ptr<Command>(Arguments)>;
+
+  /**
+   * @brief Registers the command `name` with `aliases`.
+   *
+   * @par Requires
+   * `(!name.empty() && factory)`.
+   *
+   * @throws `std::logic_error` if either the name or one of aliases is
+   * already registered.
+   */
+  DMITIGR_INTERNAL_API void add(std::string_view name, Factory factory,
+    std::initializer_list<std::string_view> aliases = {});
+
+  /**
+   * @brief Registers the command `name` of type `C` with `aliases`.
+   *
+   * @par Requires
+   * `C` must be constructible from `Arguments`.
+   */
+  template<class C>
+  void add(const std::string_view name, const std::initializer_list<std::string_view> aliases = {})
+  {
+    static_assert(std::is_base_of_v<Command, C>);
+    add(name, [](const Arguments arguments) -> std::unique_ptr<Command>
+    {
+      return std::make_unique<C>(arguments);
+    }, aliases);
+  }
+
+  /**
+   * @returns The name of the command specified by the name, alias or the
+   * unambiguous prefix `name`, or `std::nullopt` if there is no such a command.
+   *
+   * @throws `std::logic_error` if the prefix `name` is ambiguous.
+   */
+  DMITIGR_INTERNAL_API std::optional<std::string_view> resolve(std::string_view name) const;
+
+  /**
+   * @returns The new instance of the command `name`.
+   *
+   * @throws `std::logic_error` if `name` is unknown or ambiguous.
+   *
+   * @see resolve().
+   */
+  DMITIGR_INTERNAL_API std::unique_ptr<Command> make(std::string_view name, Arguments arguments) const;
+
+  /**
+   * @returns `make(arguments[0], arguments.suffix(1))`.
+   *
+   * @throws `std::logic_error` if `arguments` is empty.
+   */
+  DMITIGR_INTERNAL_API std::unique_ptr<Command> make(Arguments arguments) const;
+
+  /** @returns The names of registered commands sorted alphabetically. */
+  DMITIGR_INTERNAL_API std::vector<std::string_view> names() const;
+
+private:
+  struct Command_entry final {
+    std::string_view name;
+    Factory factory;
+  };
+
+  std::deque<std::string> strings_; // the storage of names and aliases
+  std::vector<Command_entry> commands_;
+  std::unordered_map<std::string_view, std::size_t> index_; // name or alias -> command
+  std::vector<std::pair<std::string_view, std::size_t>> sorted_index_; // for prefix lookups
+
+  std::optional<std::size_t> command_index(std::string_view name) const;
+};
+
+// -----------------------------------------------------------------------------
+// Profiling
+// -----------------------------------------------------------------------------
+
+/**
+ * @internal
+ *
+ * @brief A format of the profile report.
+ */
+enum class Profile_format {
+  /** The human-readable text. */
+  text,
+
+  /** The JSON object. */
+  json
+};
+
+/**
+ * @internal
+ *
+ * @brief Represents a profile of the command run.
+ */
+struct Profile final {
+  /** Represents a phase of the command. */
+  struct Phase final {
+    /** The name of the phase. */
+    std::string name;
+
+    /** The total time spent in the phase. */
+    std::chrono::nanoseconds time{};
+
+    /** The number of times the phase was entered. */
+    std::uint64_t count{};
+  };
+
+  /** The name of the command. */
+  std::string command;
+
+  /** The elapsed real time. */
+  std::chrono::nanoseconds wall_time{};
+
+  /** The CPU time spent by the thread which ran the command. */
+  std::chrono::nanoseconds thread_time{};
+
+  /** The CPU time spent by the process in the user mode. */
+  std::chrono::nanoseconds user_time{};
+
+  /** The CPU time spent by the process in the kernel mode. */
+  std::chrono::nanoseconds system_time{};
+
+  /** The peak resident set size of the process in bytes. */
+  std::int64_t peak_resident_size{};
+
+  /**
+   * The number of allocations made by the thread which ran the command, or
+   * `std::nullopt` if the allocations are not counted.
+   *
+   * @see DMITIGR_INTERNAL_CONSOLE_COUNT_ALLOCATIONS.
+   */
+  std::optional<std::uint64_t> allocation_count;
+
+  /** The total size of allocations, or `std::nullopt` if not counted. */
+  std::optional<std::uint64_t> allocation_size;
+
+  /** The phases in the order of the first entrance. */
+  std::vector<Phase> phases;
+};
+
+/** @returns The report of `profile` in the `format`. */
+DMITIGR_INTERNAL_API std::string to_string(const Profile& profile, Profile_format format);
+
+namespace detail {
+
+/**
+ * @internal
+ *
+ * Represents the counter of allocations of the thread.
+ */
+struct Allocation_counter final {
+  std::uint64_t count;
+  std::uint64_t size;
+};
+
+/**
+ * @internal
+ *
+ * The counter of allocations of the current thread.
+ */
+inline thread_local Allocation_counter allocation_counter__;
+
+/**
+ * @internal
+ *
+ * The indicator of the allocation counting.
+ */
+inline std::atomic<bool> is_allocation_counted__{};
+
+} // namespace detail
+
+// GCC warns about std::free() of the memory allocated by the inlined operator new.
+#if defined(__GNUC__) && !defined(__clang__)
+#define DMITIGR_INTERNAL_CONSOLE_IGNORE_MISMATCHED_NEW_DELETE__ \
+  _Pragma("GCC diagnostic push")                                \
+  _Pragma("GCC diagnostic ignored \"-Wmismatched-new-delete\"")
+#define DMITIGR_INTERNAL_CONSOLE_RESTORE_DIAGNOSTICS__ _Pragma("GCC diagnostic pop")
+#else
+#define DMITIGR_INTERNAL_CONSOLE_IGNORE_MISMATCHED_NEW_DELETE__
+#define DMITIGR_INTERNAL_CONSOLE_RESTORE_DIAGNOSTICS__
+#endif
+
+/**
+ * @internal
+ *
+ * @brief Replaces the global `operator new` and `operator delete` with the
+ * ones counting allocations for `Profile`.
+ *
+ * @remarks Must be expanded in the global namespace of exactly one translation
+ * unit of the application. The counting costs two increments of thread-local
+ * variables per allocation.
+ */
+#define DMITIGR_INTERNAL_CONSOLE_COUNT_ALLOCATIONS                            \
+  DMITIGR_INTERNAL_CONSOLE_IGNORE_MISMATCHED_NEW_DELETE__                    \
+  static const bool dmitigr_internal_console_is_allocation_counted__ =      \
+    (dmitigr::internal::console::detail::is_allocation_counted__ = true);   \
+  void* operator new(const std::size_t size)                                \
+  {                                                                          \
+    auto& counter = dmitigr::internal::console::detail::allocation_counter__; \
+    ++counter.count;                                                         \
+    counter.size += size;                                                    \
+    while (true) {                                                           \
+      if (void* const result = std::malloc(size ? size : 1))                 \
+        return result;                                                       \
+      else if (const auto handler = std::get_new_handler())                  \
+        handler();                                                           \
+      else                                                                   \
+        throw std::bad_alloc{};                                              \
+    }                                                                        \
+  }                                                                          \
+  void operator delete(void* const ptr) noexcept                            \
+  {                                                                          \
+    std::free(ptr);                                                          \
+  }                                                                          \
+  void operator delete(void* const ptr, std::size_t) noexcept               \
+  {                                                                          \
+    std::free(ptr);                                                          \
+  }                                                                          \
+  DMITIGR_INTERNAL_CONSOLE_RESTORE_DIAGNOSTICS__
+
+/**
+ * @internal
+ *
+ * @brief Profiles the command run by the current thread since the construction.
+ *
+ * @details While the instance exists it's current for the thread, so the
+ * phases marked by `Profile_phase` are accounted by it.
+ */
+class Profiler final {
+public:
+  /** Starts the profiling of the `command`. */
+  DMITIGR_INTERNAL_API explicit Profiler(std::string command);
+
+  /** Makes the previous profiler current. */
+  DMITIGR_INTERNAL_API ~Profiler();
+
+  /** Non copyable. */
+  Profiler(const Profiler&) = delete;
+
+  /** Non copyable. */
+  Profiler& operator=(const Profiler&) = delete;
+
+  /** @returns The profiler current for the thread, or `nullptr`. */
+  static Profiler* current() noexcept
+  {
+    return current_;
+  }
+
+  /** Accounts `time` spent in the phase `name`. */
+  DMITIGR_INTERNAL_API void add_phase(std::string_view name, std::chrono::nanoseconds time) noexcept;
+
+  /** @returns The profile since the construction. */
+  DMITIGR_INTERNAL_API Profile profile() const;
+
+private:
+  inline static thread_local Profiler* current_{};
+  Profiler* previous_{};
+  Profile profile_;
+  std::chrono::steady_clock::time_point start_time_;
+  std::chrono::nanoseconds thread_time_{};
+  std::chrono::nanoseconds user_time_{};
+  std::chrono::nanoseconds system_time_{};
+  detail::Allocation_counter allocations_{};
+};
+
+/**
+ * @internal
+ *
+ * @brief Accounts the time of the scope as the phase of the current profiler.
+ *
+ * @details Costs one read of a thread-local variable if there is no current
+ * profiler, for example:
+ * @code
+ * void Exec_command::run()
+ * {
+ *   {
+ *     const Profile_phase phase{"connect"};
+ *     connect();
+ *   }
+ *   const Profile_phase phase{"execute"};
+ *   execute();
+ * }
+ * @endcode
+ */
+class Profile_phase final {
+public:
+  /** Starts the phase `name`. */
+  explicit Profile_phase(const std::string_view name) noexcept
+    : profiler_{Profiler::current()}
+    , name_{name}
+  {
+    if (profiler_)
+      start_time_ = std::chrono::steady_clock::now();
+  }
+
+  /** Ends the phase. */
+  ~Profile_phase()
+  {
+    if (profiler_)
+      profiler_->add_phase(name_, std::chrono::steady_clock::now() - start_time_);
+  }
+
+  /** Non copyable. */
+  Profile_phase(const Profile_phase&) = delete;
+
+  /** Non copyable. */
+  Profile_phase& operator=(const Profile_phase&) = delete;
+
+private:
+  Profiler* profiler_{};
+  std::string_view name_;
+  std::chrono::steady_clock::time_point start_time_;
+};
+
+/**
+ * @internal
+ *
+ * @brief Makes the command specified by `arguments` and runs it.
+ *
+ * @details If the first argument is the global option `--profile[=text|json]`
+ * the command is profiled and the report is written to `report_output` after
+ * the command completes (even if it fails).
+ *
+ * @param output - The output stream of the command.
+ * @param report_output - The output stream of the profile report.
+ *
+ * @throws `std::logic_error` if the command is unknown or ambiguous, or if
+ * the global option is invalid. Rethrows exceptions of the command.
+ */
+DMITIGR_INTERNAL_API void run_command(const Command_registry& registry, Arguments arguments,
+  std::ostream& output = std::cout, std::ostream& report_output = std::cerr);
+
+/**
+ * @internal
+ *
+ * @brief Runs the commands of the registry inside the long-lived process.
+ *
+ * @details Each line of the input is a command line, whose arguments are
+ * separated according to the rules of `stream::read_simple_phrase_to_string()`.
+ * The lines are treated as independent commands and can be run concurrently.
+ * The output of each command is collected separately (see `Command::output()`)
+ * and written as the frame:
+ *   <line number> <exit status> <output size>\n<output>
+ * The frames are written by the calling thread in the order of completion,
+ * which may differ from the order of the input unless `concurrency` is `1`. The exit status is one
+ * of the constants `exit_success`, `exit_failure` or `exit_usage`. In case of
+ * failure, the output contains the error message.
+ *
+ * The warm state (configuration, caches, connections) can be shared between
+ * the commands by the factories of the registry. The commands are run by
+ * `run_command()`, so the profile reports are written to the frames too.
+ */
+class Batch_runner final {
+public:
+  /** The exit status of the command completed successfully. */
+  static constexpr int exit_success{0};
+
+  /** The exit status of the command failed with an exception. */
+  static constexpr int exit_failure{1};
+
+  /** The exit status of the command failed with `std::logic_error` (invalid usage). */
+  static constexpr int exit_usage{2};
+
+  /** Represents a result of the command. */
+  struct Result final {
+    int exit_status{};
+    std::string output;
+  };
+
+  /**
+   * @brief The constructor.
+   *
+   * @param registry - The registry of the commands to run.
+   * @param concurrency - The maximum number of commands to run concurrently
+   * by all the calls of `run()` (including the ones of `serve()`), or `0` to
+   * use the value of `std::thread::hardware_concurrency()`.
+   *
+   * @remarks The `registry` must outlive the instance. The pool of workers is
+   * started by the first call of `run()`.
+   */
+  explicit Batch_runner(const Command_registry& registry, const std::size_t concurrency = 0) noexcept
+    : registry_{registry}
+    , concurrency_{concurrency}
+  {}
+
+  /** Stops the pool of workers. */
+  DMITIGR_INTERNAL_API ~Batch_runner();
+
+  /** Non copy-constructible. */
+  Batch_runner(const Batch_runner&) = delete;
+
+  /** Non copy-assignable. */
+  Batch_runner& operator=(const Batch_runner&) = delete;
+
+  /** Runs the command line `line` and collects its output. */
+  DMITIGR_INTERNAL_API Result execute(const std::string& line) const;
+
+  /** Runs the command specified by `arguments` and collects its output. */
+  DMITIGR_INTERNAL_API Result execute(Arguments arguments) const;
+
+  /**
+   * @brief Runs the commands of `input` until the end of it, writing the
+   * frames with results to `output`.
+   */
+  DMITIGR_INTERNAL_API void run(std::istream& input, std::ostream& output) const;
+
+#ifndef _WIN32
+  /**
+   * @brief Accepts the connections on the Unix domain socket `path` and runs
+   * `run()` for each connection concurrently until `stop()` is called.
+   *
+   * @details The existing socket file `path` is replaced, and removed upon
+   * return. Each connection is served by its own threads, but the commands
+   * of all the connections are run by the shared pool of workers, so the
+   * connection which isn't read by the client stalls only itself.
+   *
+   * @par Requires
+   * No other call of `serve()` is in progress. (The instance can be served
+   * again after the return.)
+   *
+   * @throws `std::system_error` on failure.
+   */
+  DMITIGR_INTERNAL_API void serve(const std::filesystem::path& path);
+
+  /**
+   * @brief Stops `serve()` in progress by closing the listening socket and
+   * connections.
+   *
+   * @remarks This method can be called from any thread.
+   */
+  DMITIGR_INTERNAL_API void stop() noexcept;
+#endif
+
+  /** The pool of workers. (Implementation detail.) */
+  class Worker_pool;
+
+private:
+  const Command_registry& registry_;
+  std::size_t concurrency_{};
+  mutable std::once_flag worker_pool_once_;
+  mutable std::unique_ptr<Worker_pool> worker_pool_;
+
+  Worker_pool* worker_pool() const;
+#ifndef _WIN32
+  std::atomic<bool> is_stopped_{};
+  std::mutex sockets_mutex_;
+  std::vector<int> sockets_; // the listening socket and connections
+#endif
 };
 
 /**
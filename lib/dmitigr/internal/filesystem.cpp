@@ -2,11 +2,28 @@
 // Copyright (C) Dmitry Igrishin
 // For conditions of distribution and use, see files LICENSE.txt or internal.hpp
 
+#include "dmitigr/internal/concurrency.hpp"
 #include "dmitigr/internal/debug.hpp"
 #include "dmitigr/internal/filesystem.hpp"
+#include "dmitigr/internal/hash.hpp"
+#include "dmitigr/internal/os.hpp"
 #include "dmitigr/internal/stream.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <mutex>
 #include <stdexcept>
+#include <system_error>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
 
 #include "dmitigr/internal/implementation_header.hpp"
 
@@ -28,23 +45,284 @@ DMITIGR_INTERNAL_INLINE std::vector<std::filesystem::path> files_by_extension(co
   }
 
   if (is_directory(root)) {
-    const auto traverse = [&](auto iterator)
+    const auto is_match = [&extension](const std::filesystem::directory_entry& dirent)
     {
-      for (const auto& dirent : iterator) {
-        const auto& path = dirent.path();
-        if (is_regular_file(path) && path.extension() == extension)
-          result.push_back(dirent);
-      }
+      return is_regular_file(dirent.status()) && dirent.path().extension() == extension;
     };
+    for (const auto& dirent : entries(root, is_match, recursive))
+      result.push_back(dirent.path());
+  }
+  return result;
+}
 
-    if (recursive)
-      traverse(std::filesystem::recursive_directory_iterator{root});
-    else
-      traverse(std::filesystem::directory_iterator{root});
+// -----------------------------------------------------------------------------
+
+namespace {
+
+/**
+ * @returns The result of matching of the character class which starts at
+ * `pattern[pos]` against `ch` as the first element, and the position after
+ * the class as the second element, or `std::nullopt` if the class is not
+ * terminated.
+ */
+inline std::optional<std::pair<bool, std::size_t>> glob_class_match__(const std::string_view pattern,
+  std::size_t pos, const char ch)
+{
+  DMITIGR_INTERNAL_ASSERT(pattern[pos] == '[');
+  const auto size = pattern.size();
+  bool is_negated{};
+  if (++pos < size && pattern[pos] == '!') {
+    is_negated = true;
+    ++pos;
+  }
+  bool is_matched{};
+  for (bool is_first = true; pos < size && (is_first || pattern[pos] != ']'); is_first = false) {
+    if (pos + 2 < size && pattern[pos + 1] == '-' && pattern[pos + 2] != ']') {
+      is_matched = is_matched || (pattern[pos] <= ch && ch <= pattern[pos + 2]);
+      pos += 3;
+    } else
+      is_matched = is_matched || pattern[pos++] == ch;
+  }
+  if (pos < size)
+    return std::make_pair(is_matched != is_negated, pos + 1);
+  else
+    return std::nullopt;
+}
+
+/**
+ * @returns `true` if `str` matches the glob `pattern`.
+ *
+ * @see Path_matcher.
+ */
+inline bool glob_match__(const std::string_view pattern, const std::string_view str)
+{
+  constexpr auto npos = std::string_view::npos;
+  std::size_t p{}, s{}, star_p{npos}, star_s{};
+  while (s < str.size()) {
+    if (p < pattern.size()) {
+      const char pc = pattern[p];
+      if (pc == '*') {
+        star_p = ++p;
+        star_s = s;
+        continue;
+      } else if (str[s] != '/') {
+        if (pc == '?') {
+          ++p;
+          ++s;
+          continue;
+        } else if (pc == '[') {
+          if (const auto m = glob_class_match__(pattern, p, str[s])) {
+            if (m->first) {
+              p = m->second;
+              ++s;
+              continue;
+            }
+            goto backtrack;
+          } // else the '[' is not a class
+        }
+      }
+      if (pc == str[s]) {
+        ++p;
+        ++s;
+        continue;
+      }
+    }
+
+  backtrack:
+    // Let the last star consume one more character (except the separator).
+    if (star_p != npos && str[star_s] != '/') {
+      p = star_p;
+      s = ++star_s;
+    } else
+      return false;
+  }
+  while (p < pattern.size() && pattern[p] == '*')
+    ++p;
+  return p == pattern.size();
+}
+
+/**
+ * @returns The filename part of the `path`.
+ */
+inline std::string_view filename__(const std::string_view path)
+{
+  const auto pos = path.rfind('/');
+  return pos != std::string_view::npos ? path.substr(pos + 1) : path;
+}
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE void Path_matcher::add(const std::string_view pattern, const std::size_t category)
+{
+  Rule rule{rule_count_, category, std::string{pattern}, pattern.find('/') != std::string_view::npos};
+
+  // Try to treat the pattern as "*.ext".
+  if (pattern.size() > 2 && pattern[0] == '*' && pattern[1] == '.' &&
+    pattern.find_first_of("*?[./", 1) == 1 && pattern.find_first_of("*?[./", 2) == std::string_view::npos)
+    extension_rules_.emplace(std::string{pattern.substr(1)}, std::move(rule));
+  else
+    glob_rules_.push_back(std::move(rule));
+
+  ++rule_count_;
+  category_count_ = std::max(category_count_, category + 1);
+}
+
+DMITIGR_INTERNAL_INLINE void Path_matcher::exclude_directory(const std::string_view pattern)
+{
+  exclusion_rules_.push_back(Rule{rule_count_++, 0, std::string{pattern}, pattern.find('/') != std::string_view::npos});
+}
+
+DMITIGR_INTERNAL_INLINE std::optional<std::size_t> Path_matcher::match(const std::string_view relative_path) const
+{
+  const auto filename = filename__(relative_path);
+
+  const Rule* extension_rule{};
+  if (!extension_rules_.empty()) {
+    if (const auto pos = filename.rfind('.'); pos != std::string_view::npos) {
+      if (const auto i = extension_rules_.find(filename.substr(pos)); i != cend(extension_rules_))
+        extension_rule = &i->second;
+    }
   }
+
+  // The glob rules added before the extension rule have priority.
+  for (const auto& rule : glob_rules_) {
+    if (extension_rule && rule.order > extension_rule->order)
+      break;
+    else if (glob_match__(rule.pattern, rule.is_path_pattern ? relative_path : filename))
+      return rule.category;
+  }
+
+  return extension_rule ? std::make_optional(extension_rule->category) : std::nullopt;
+}
+
+DMITIGR_INTERNAL_INLINE bool Path_matcher::is_directory_excluded(const std::string_view relative_path) const
+{
+  const auto filename = filename__(relative_path);
+  return std::any_of(cbegin(exclusion_rules_), cend(exclusion_rules_), [&](const Rule& rule)
+  {
+    return glob_match__(rule.pattern, rule.is_path_pattern ? relative_path : filename);
+  });
+}
+
+DMITIGR_INTERNAL_INLINE std::vector<std::vector<std::filesystem::path>> files_by_matcher(const std::filesystem::path& root,
+  const Path_matcher& matcher, const bool recursive)
+{
+  std::vector<std::vector<std::filesystem::path>> result(matcher.category_count());
+  if (!is_directory(root))
+    return result;
+
+#ifdef _WIN32
+  const auto root_size = root.generic_string().size();
+  std::string buffer;
+#else
+  const auto root_size = root.native().size();
+#endif
+  const auto relative_path = [&](const std::filesystem::path& path)
+  {
+#ifdef _WIN32
+    buffer = path.generic_string();
+    std::string_view result{buffer};
+#else
+    std::string_view result{path.native()};
+#endif
+    result.remove_prefix(std::min(root_size, result.size()));
+    while (!result.empty() && result.front() == '/')
+      result.remove_prefix(1);
+    return result;
+  };
+
+  std::size_t category{};
+  const auto filter = [&](const std::filesystem::directory_entry& dirent)
+  {
+    if (const auto c = matcher.match(relative_path(dirent.path())); c && is_regular_file(dirent.status())) {
+      category = *c;
+      return true;
+    } else
+      return false;
+  };
+  Entry_range::Filter prune;
+  if (recursive) {
+    prune = [&](const std::filesystem::directory_entry& dirent)
+    {
+      return is_directory(dirent.status()) && matcher.is_directory_excluded(relative_path(dirent.path()));
+    };
+  }
+
+  for (const auto& dirent : entries(root, filter, recursive, std::move(prune)))
+    result[category].push_back(dirent.path());
+
   return result;
 }
 
+// -----------------------------------------------------------------------------
+
+DMITIGR_INTERNAL_INLINE Entry_range::Entry_range(const std::filesystem::path& root, Filter filter,
+  const bool recursive, Filter prune)
+  : filter_{std::move(filter)}
+  , prune_{std::move(prune)}
+  , recursive_{recursive}
+{
+  if (is_directory(root))
+    iterator_ = std::filesystem::recursive_directory_iterator{root};
+}
+
+DMITIGR_INTERNAL_INLINE auto Entry_range::begin() -> Iterator
+{
+  DMITIGR_INTERNAL_ASSERT(!is_started_);
+  is_started_ = true;
+  return settle() ? Iterator{this} : Iterator{};
+}
+
+DMITIGR_INTERNAL_INLINE bool Entry_range::next()
+{
+  step();
+  return settle();
+}
+
+DMITIGR_INTERNAL_INLINE bool Entry_range::settle()
+{
+  const std::filesystem::recursive_directory_iterator e;
+  while (iterator_ != e) {
+    if (!filter_ || filter_(*iterator_))
+      return true;
+    step();
+  }
+  return false;
+}
+
+DMITIGR_INTERNAL_INLINE void Entry_range::step()
+{
+  DMITIGR_INTERNAL_ASSERT(iterator_ != std::filesystem::recursive_directory_iterator{});
+  if (!recursive_ || (prune_ && prune_(*iterator_)))
+    iterator_.disable_recursion_pending();
+  ++iterator_;
+}
+
+// -----------------------------------------------------------------------------
+
+DMITIGR_INTERNAL_INLINE Line_range::Line_range(const std::filesystem::path& path)
+  : stream_{path}
+{}
+
+DMITIGR_INTERNAL_INLINE auto Line_range::begin() -> Iterator
+{
+  DMITIGR_INTERNAL_ASSERT(!is_started_);
+  is_started_ = true;
+  return next() ? Iterator{this} : Iterator{};
+}
+
+DMITIGR_INTERNAL_INLINE bool Line_range::next()
+{
+  return static_cast<bool>(getline(stream_, line_));
+}
+
+DMITIGR_INTERNAL_INLINE std::vector<std::string> read_lines_to_vector(const std::filesystem::path& path)
+{
+  return std::vector<std::string>(lines(path).begin(), Line_range::Iterator{});
+}
+
+// -----------------------------------------------------------------------------
+
 DMITIGR_INTERNAL_INLINE std::string read_to_string(const std::filesystem::path& path)
 {
   std::ifstream stream(path, std::ios_base::in | std::ios_base::binary);
@@ -54,6 +332,644 @@ DMITIGR_INTERNAL_INLINE std::string read_to_string(const std::filesystem::path&
     throw std::runtime_error{"unable to open file \"" + path.generic_string() + "\""};
 }
 
+namespace {
+
+inline std::ifstream open_for_reading__(const std::filesystem::path& path)
+{
+  std::ifstream result{path, std::ios_base::in | std::ios_base::binary};
+  if (!result)
+    throw std::runtime_error{"unable to open file \"" + path.generic_string() + "\""};
+  return result;
+}
+
+/**
+ * @returns The content of the file. Reads it by the single call if the size
+ * of the file is known.
+ */
+inline std::string read_whole_file__(const std::filesystem::path& path)
+{
+  auto stream = open_for_reading__(path);
+  std::string result;
+  std::error_code ec;
+  if (const auto size = std::filesystem::file_size(path, ec); !ec && size) {
+    result.resize(size);
+    stream.read(result.data(), static_cast<std::streamsize>(size));
+    result.resize(static_cast<std::size_t>(stream.gcount()));
+  }
+  if (stream)
+    result.append(stream::read_to_string(stream));
+  if (stream.bad())
+    throw std::runtime_error{"unable to read file \"" + path.generic_string() + "\""};
+  return result;
+}
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE void load_files(const std::vector<std::filesystem::path>& paths,
+  const Load_callback& callback, const std::size_t concurrency)
+{
+  DMITIGR_INTERNAL_ASSERT(callback);
+  std::mutex callback_mutex;
+  concurrency::for_each_index(paths.size(), concurrency, [&](const std::size_t i)
+  {
+    std::string content;
+    std::exception_ptr error;
+    try {
+      content = read_whole_file__(paths[i]);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    const std::lock_guard lg{callback_mutex};
+    callback(i, std::move(content), std::move(error));
+  });
+}
+
+DMITIGR_INTERNAL_INLINE void Loaded_files::allocate(const std::vector<std::filesystem::path>& paths,
+  const std::size_t concurrency)
+{
+  slots_.resize(paths.size());
+
+  // Determine the sizes of the files.
+  concurrency::for_each_index(paths.size(), concurrency, [&](const std::size_t i)
+  {
+    try {
+      slots_[i].size = static_cast<std::size_t>(std::filesystem::file_size(paths[i]));
+    } catch (...) {
+      slots_[i].error = std::current_exception();
+    }
+  });
+
+  // Distribute the buffer among the files.
+  std::size_t total_size{};
+  for (auto& slot : slots_) {
+    slot.offset = total_size;
+    total_size += slot.size;
+  }
+  buffer_.resize(total_size);
+}
+
+DMITIGR_INTERNAL_INLINE Loaded_files load_files_to_arena(const std::vector<std::filesystem::path>& paths,
+  const std::size_t concurrency)
+{
+  Loaded_files result;
+  result.allocate(paths, concurrency);
+  auto& slots = result.slots_;
+
+  // Read the files.
+  concurrency::for_each_index(paths.size(), concurrency, [&](const std::size_t i)
+  {
+    auto& slot = slots[i];
+    if (slot.error)
+      return;
+
+    try {
+      auto stream = open_for_reading__(paths[i]);
+      stream.read(result.buffer_.data() + slot.offset, static_cast<std::streamsize>(slot.size));
+      if (static_cast<std::size_t>(stream.gcount()) != slot.size || stream.peek() != std::ifstream::traits_type::eof())
+        throw std::runtime_error{"file \"" + paths[i].generic_string() + "\" changed in size while loading"};
+    } catch (...) {
+      slot.size = 0;
+      slot.error = std::current_exception();
+    }
+  });
+
+  return result;
+}
+
+#ifndef _WIN32
+
+DMITIGR_INTERNAL_INLINE Loaded_files load_files_to_arena(const std::vector<std::filesystem::path>& paths,
+  os::io::Async_io& aio)
+{
+  if (aio.pending_count())
+    throw std::logic_error{"cannot load files by using the asynchronous I/O engine"
+      " with pending requests"};
+
+  Loaded_files result;
+  result.allocate(paths, 0);
+  auto& slots = result.slots_;
+
+  struct State final {
+    int fd{-1};
+    std::size_t done{};
+    char probe{}; // the target of the read past the end of file
+  };
+  std::vector<State> states(paths.size());
+
+  /*
+   * On exception, the reads in flight must be completed before the buffer is
+   * released, and the files must be closed. If the waiting fails, there is
+   * no way to prevent the kernel from writing to the released memory.
+   */
+  struct Guard final {
+    os::io::Async_io& aio;
+    std::vector<State>& states;
+    bool is_dismissed{};
+
+    ~Guard()
+    {
+      if (is_dismissed)
+        return;
+
+      try {
+        std::vector<os::io::Async_completion> completions;
+        while (aio.pending_count()) {
+          completions.clear();
+          aio.reap(completions);
+        }
+      } catch (...) {
+        std::terminate();
+      }
+      for (auto& state : states) {
+        if (state.fd >= 0) {
+          ::close(state.fd);
+          state.fd = -1;
+        }
+      }
+    }
+  } guard{aio, states};
+
+  const auto fail = [&](const std::size_t i, std::exception_ptr error)
+  {
+    if (states[i].fd >= 0) {
+      ::close(states[i].fd);
+      states[i].fd = -1;
+    }
+    slots[i].size = 0;
+    slots[i].error = std::move(error);
+  };
+  /*
+   * Once the file is read, the one byte past the end of it is read in order
+   * to detect the growth of the file, like it's done by the threaded overload.
+   */
+  const auto prepare_read = [&](const std::size_t i)
+  {
+    auto& state = states[i];
+    const bool is_probe = state.done == slots[i].size;
+    os::io::Async_request request;
+    request.fd = state.fd;
+    request.buffer = is_probe ? &state.probe : result.buffer_.data() + slots[i].offset + state.done;
+    request.count = is_probe ? 1 : slots[i].size - state.done;
+    request.offset = state.done;
+    request.user_data = i;
+    aio.prepare(request);
+  };
+  const auto changed_in_size_error = [&](const std::size_t i)
+  {
+    return std::make_exception_ptr(std::runtime_error{"file \"" + paths[i].generic_string() +
+        "\" changed in size while loading"});
+  };
+
+  /*
+   * Open the files and prepare the reads keeping at most queue_depth()
+   * files open at a time.
+   */
+  std::size_t next{};
+  std::size_t open_count{};
+  std::vector<os::io::Async_completion> completions;
+  while (next < paths.size() || open_count) {
+    for (; next < paths.size() && open_count < aio.queue_depth(); ++next) {
+      if (slots[next].error)
+        continue;
+      if (const int fd = ::open(paths[next].c_str(), O_RDONLY | O_CLOEXEC); fd >= 0) {
+        states[next].fd = fd;
+        ++open_count;
+        prepare_read(next);
+      } else
+        fail(next, std::make_exception_ptr(std::runtime_error{"unable to open file \"" +
+              paths[next].generic_string() + "\""}));
+    }
+    if (!open_count)
+      break;
+
+    completions.clear();
+    aio.reap(completions);
+    for (const auto& completion : completions) {
+      const auto i = static_cast<std::size_t>(completion.user_data);
+      auto& state = states[i];
+      if (completion.result < 0) {
+        fail(i, std::make_exception_ptr(std::system_error{int(-completion.result), std::system_category(),
+              "unable to read file \"" + paths[i].generic_string() + "\""}));
+        --open_count;
+      } else if (state.done == slots[i].size) {
+        if (completion.result)
+          fail(i, changed_in_size_error(i));
+        else {
+          ::close(state.fd);
+          state.fd = -1;
+        }
+        --open_count;
+      } else if (completion.result == 0) {
+        fail(i, changed_in_size_error(i));
+        --open_count;
+      } else {
+        state.done += static_cast<std::size_t>(completion.result);
+        prepare_read(i);
+      }
+    }
+  }
+
+  guard.is_dismissed = true;
+  return result;
+}
+
+#endif  // _WIN32
+
+// -----------------------------------------------------------------------------
+
+DMITIGR_INTERNAL_INLINE std::uint64_t content_fingerprint(const std::filesystem::path& path)
+{
+  constexpr std::size_t block_size{256 * 1024};
+  const std::unique_ptr<char[]> block{new char[block_size]};
+  auto stream = open_for_reading__(path);
+  hash::Xxh64 result;
+  do {
+    stream.read(block.get(), block_size);
+    result.update(block.get(), static_cast<std::size_t>(stream.gcount()));
+  } while (stream);
+  if (stream.bad())
+    throw std::runtime_error{"unable to read file \"" + path.generic_string() + "\""};
+  return result.digest();
+}
+
+DMITIGR_INTERNAL_INLINE Directory_fingerprint directory_fingerprint(const std::filesystem::path& root,
+  const std::filesystem::path& extension, const bool recursive, const std::size_t concurrency)
+{
+  auto paths = files_by_extension(root, extension, recursive);
+  std::sort(begin(paths), end(paths));
+
+  Directory_fingerprint result;
+  auto& files = result.files;
+  files.resize(paths.size());
+  concurrency::for_each_index(paths.size(), concurrency, [&](const std::size_t i)
+  {
+    files[i].first = paths[i].lexically_relative(root);
+    files[i].second = content_fingerprint(paths[i]);
+  });
+
+  hash::Xxh64 hash;
+  for (const auto& [path, fingerprint] : files) {
+    const auto name = path.generic_string();
+    hash.update(name.data(), name.size() + 1); // including the terminating zero
+    unsigned char bytes[sizeof(fingerprint)];
+    for (std::size_t i = 0; i < sizeof(bytes); ++i)
+      bytes[i] = static_cast<unsigned char>(fingerprint >> (8 * i));
+    hash.update(bytes, sizeof(bytes));
+  }
+  result.value = hash.digest();
+  return result;
+}
+
+// -----------------------------------------------------------------------------
+
+#ifndef _WIN32
+
+namespace {
+
+/**
+ * @brief Opens the file `from` for reading and the file `to` for writing and
+ * calls `f(in_fd, out_fd, size_of_from)`.
+ */
+template<typename F>
+auto with_files_to_copy__(const char* const fn, const std::filesystem::path& from, const std::filesystem::path& to, F&& f)
+{
+  const auto throw_error = [fn](const std::filesystem::path& path)
+  {
+    const int err = errno;
+    throw std::system_error{err, std::system_category(),
+      std::string{"dmitigr::internal::filesystem::"}.append(fn).append(": \"")
+      .append(path.generic_string()).append("\"")};
+  };
+  const auto close = [](int* const fd){ ::close(*fd); };
+
+  int in_fd = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in_fd < 0)
+    throw_error(from);
+  const std::unique_ptr<int, decltype(close)> in_guard{&in_fd, close};
+
+  struct stat st;
+  if (::fstat(in_fd, &st) != 0)
+    throw_error(from);
+
+  int out_fd = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777);
+  if (out_fd < 0)
+    throw_error(to);
+  const std::unique_ptr<int, decltype(close)> out_guard{&out_fd, close};
+
+  return f(in_fd, out_fd, static_cast<std::uint64_t>(st.st_size));
+}
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE std::uintmax_t copy_file_content(const std::filesystem::path& from, const std::filesystem::path& to)
+{
+  return with_files_to_copy__("copy_file_content()", from, to, [](const int in_fd, const int out_fd, std::uint64_t count)
+  {
+    // Transfer until the end of the input in case the file grows.
+    std::uintmax_t result{};
+    for (;; count = 1024 * 1024) {
+      const auto n = os::io::transfer(in_fd, out_fd, result, count);
+      result += n;
+      if (n < count)
+        break;
+    }
+    return result;
+  });
+}
+
+DMITIGR_INTERNAL_INLINE std::uintmax_t copy_sparse_file_content(const std::filesystem::path& from,
+  const std::filesystem::path& to)
+{
+  return with_files_to_copy__("copy_sparse_file_content()", from, to, [](const int in_fd, const int out_fd, std::uint64_t)
+  {
+    return std::uintmax_t{os::io::copy_sparse(in_fd, out_fd)};
+  });
+}
+
+#endif  // _WIN32
+
+// -----------------------------------------------------------------------------
+
+#ifndef _WIN32
+
+namespace {
+
+[[noreturn]] inline void throw_file_writer_error__(const char* const fn)
+{
+  const int err = errno;
+  throw std::system_error{err, std::system_category(),
+    std::string{"dmitigr::internal::filesystem::File_writer::"}.append(fn)};
+}
+
+inline std::atomic<unsigned long> file_writer_temp_counter__;
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE File_writer::File_writer(const std::filesystem::path& path)
+  : File_writer{path, Options{}}
+{}
+
+DMITIGR_INTERNAL_INLINE File_writer::File_writer(const std::filesystem::path& path, const Options& options)
+  : path_{path}
+  , buffer_{nullptr, &std::free}
+{
+  constexpr int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+  if (options.is_atomic) {
+    // Create the temporary file in the same directory to make rename() atomic.
+    struct stat target_stat;
+    const bool is_target_exists = ::stat(path.c_str(), &target_stat) == 0;
+    const auto name = "." + path.filename().string() + ".tmp." + std::to_string(::getpid()) + ".";
+    do {
+      temp_path_ = path;
+      temp_path_.replace_filename(name + std::to_string(++file_writer_temp_counter__));
+      fd_ = ::open(temp_path_.c_str(), flags | O_EXCL, 0666);
+    } while (fd_ < 0 && errno == EEXIST);
+    if (fd_ < 0)
+      throw_file_writer_error__("File_writer()");
+
+    // Preserve the permissions of the target file.
+    if (is_target_exists && ::fchmod(fd_, target_stat.st_mode & 07777) != 0) {
+      const int err = errno;
+      ::close(fd_);
+      ::unlink(temp_path_.c_str());
+      errno = err;
+      throw_file_writer_error__("File_writer()");
+    }
+  } else {
+    fd_ = ::open(path.c_str(), flags | O_TRUNC, 0666);
+    if (fd_ < 0)
+      throw_file_writer_error__("File_writer()");
+  }
+
+#ifdef __linux__
+  /*
+   * Preallocate the space without changing the size of the file, so there
+   * is no need to truncate the file if it will be smaller than expected.
+   * Filesystems that doesn't support fallocate() are ignored.
+   */
+  if (options.expected_size)
+    ::fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(options.expected_size));
+#endif
+
+  const auto page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  buffer_capacity_ = std::max(options.buffer_size, page_size);
+  buffer_capacity_ = (buffer_capacity_ + page_size - 1) / page_size * page_size;
+  void* buffer{};
+  if (const int err = ::posix_memalign(&buffer, page_size, buffer_capacity_)) {
+    ::close(fd_);
+    if (!temp_path_.empty())
+      ::unlink(temp_path_.c_str());
+    throw std::system_error{err, std::system_category(), "dmitigr::internal::filesystem::File_writer::File_writer()"};
+  }
+  buffer_.reset(static_cast<char*>(buffer));
+}
+
+DMITIGR_INTERNAL_INLINE File_writer::~File_writer()
+{
+  if (fd_ >= 0) {
+    if (temp_path_.empty()) {
+      try {
+        flush();
+      } catch (...) {}
+      ::close(fd_);
+    } else {
+      ::close(fd_);
+      ::unlink(temp_path_.c_str());
+    }
+  }
+}
+
+DMITIGR_INTERNAL_INLINE void File_writer::write(const void* const data, const std::size_t size)
+{
+  DMITIGR_INTERNAL_ASSERT(!is_committed());
+  DMITIGR_INTERNAL_ASSERT(data || !size);
+
+  const auto available = buffer_capacity_ - buffer_size_;
+  if (size <= available) {
+    std::memcpy(buffer_.get() + buffer_size_, data, size);
+    buffer_size_ += size;
+  } else if (size < buffer_capacity_) {
+    // Fill the buffer up, write it and buffer the rest.
+    const auto* const bytes = static_cast<const char*>(data);
+    std::memcpy(buffer_.get() + buffer_size_, bytes, available);
+    buffer_size_ = buffer_capacity_;
+    flush();
+    std::memcpy(buffer_.get(), bytes + available, size - available);
+    buffer_size_ = size - available;
+  } else
+    // The data is large enough to be written without copying.
+    write_buffer_and(data, size);
+  size_ += size;
+}
+
+DMITIGR_INTERNAL_INLINE void File_writer::flush()
+{
+  DMITIGR_INTERNAL_ASSERT(!is_committed());
+  write_buffer_and(nullptr, 0);
+}
+
+DMITIGR_INTERNAL_INLINE void File_writer::commit()
+{
+  DMITIGR_INTERNAL_ASSERT(!is_committed());
+  flush();
+  if (::fsync(fd_) != 0)
+    throw_file_writer_error__("commit()");
+
+  const int fd = fd_;
+  fd_ = -1;
+  if (::close(fd) != 0) {
+    if (!temp_path_.empty())
+      ::unlink(temp_path_.c_str());
+    throw_file_writer_error__("commit()");
+  }
+
+  if (!temp_path_.empty()) {
+    if (::rename(temp_path_.c_str(), path_.c_str()) != 0) {
+      const int err = errno;
+      ::unlink(temp_path_.c_str());
+      errno = err;
+      throw_file_writer_error__("commit()");
+    }
+
+    // Make the rename durable.
+    auto dir = path_.parent_path();
+    if (dir.empty())
+      dir = ".";
+    if (const int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC); dir_fd >= 0) {
+      const int result = ::fsync(dir_fd);
+      ::close(dir_fd);
+      if (result != 0)
+        throw_file_writer_error__("commit()");
+    } else
+      throw_file_writer_error__("commit()");
+  }
+  is_committed_ = true;
+}
+
+DMITIGR_INTERNAL_INLINE void File_writer::write_buffer_and(const void* const data, const std::size_t size)
+{
+  ::iovec iov[2];
+  int iovcnt{};
+  if (buffer_size_)
+    iov[iovcnt++] = {buffer_.get(), buffer_size_};
+  if (size)
+    iov[iovcnt++] = {const_cast<void*>(data), size};
+  os::io::writev_fully(fd_, iov, iovcnt);
+  buffer_size_ = 0;
+}
+
+// -----------------------------------------------------------------------------
+
+namespace {
+
+[[noreturn]] inline void throw_sequential_reader_error__(const char* const fn)
+{
+  throw std::system_error{errno, std::system_category(),
+    std::string{"dmitigr::internal::filesystem::Sequential_reader::"}.append(fn)};
+}
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE Sequential_reader::Sequential_reader(const std::filesystem::path& path)
+  : Sequential_reader{path, Options{}}
+{}
+
+DMITIGR_INTERNAL_INLINE Sequential_reader::Sequential_reader(const std::filesystem::path& path,
+  const Options& options)
+  : path_{path}
+  , buffer_{nullptr, &std::free}
+  , is_cache_dropped_{options.is_cache_dropped}
+{
+  constexpr int flags = O_RDONLY | O_CLOEXEC;
+#ifdef O_DIRECT
+  if (options.is_direct) {
+    fd_ = ::open(path.c_str(), flags | O_DIRECT);
+    is_direct_ = fd_ >= 0;
+  }
+#endif
+  if (fd_ < 0) {
+    fd_ = ::open(path.c_str(), flags);
+    if (fd_ < 0)
+      throw_sequential_reader_error__("Sequential_reader()");
+    switch_to_buffered_mode();
+  }
+
+  /*
+   * The page size is a multiple of the logical block size of the storage
+   * devices, so the buffer and the offsets are suitably aligned for O_DIRECT.
+   */
+  const auto page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  buffer_capacity_ = std::max(options.buffer_size, page_size);
+  buffer_capacity_ = (buffer_capacity_ + page_size - 1) / page_size * page_size;
+  void* buffer{};
+  if (const int err = ::posix_memalign(&buffer, page_size, buffer_capacity_)) {
+    ::close(fd_);
+    throw std::system_error{err, std::system_category(),
+      "dmitigr::internal::filesystem::Sequential_reader::Sequential_reader()"};
+  }
+  buffer_.reset(static_cast<char*>(buffer));
+}
+
+DMITIGR_INTERNAL_INLINE Sequential_reader::~Sequential_reader()
+{
+  ::close(fd_);
+}
+
+DMITIGR_INTERNAL_INLINE std::string_view Sequential_reader::read()
+{
+  std::size_t count{};
+  while (true) {
+    const auto result = ::pread(fd_, buffer_.get(), buffer_capacity_, static_cast<off_t>(offset_));
+    if (result >= 0) {
+      count = static_cast<std::size_t>(result);
+      break;
+    } else if (errno == EINTR)
+      continue;
+    else if (errno == EINVAL && is_direct_)
+      // The offset is unaligned after the short read, or O_DIRECT is unusable.
+      switch_to_buffered_mode();
+    else
+      throw_sequential_reader_error__("read()");
+  }
+  offset_ += count;
+
+#ifdef POSIX_FADV_DONTNEED
+  /*
+   * Drop the pages behind the cursor (the data is already in the buffer).
+   * The page cache may hold the file in large folios, which are dropped only
+   * if entirely covered by the range, so the range overlaps the previous one
+   * by the size of the largest folio.
+   */
+  if (!is_direct_ && is_cache_dropped_ && offset_ > dropped_offset_) {
+    const std::uintmax_t overlap = os::huge_page_size();
+    const auto from = dropped_offset_ > overlap ? dropped_offset_ - overlap : 0;
+    ::posix_fadvise(fd_, static_cast<off_t>(from), static_cast<off_t>(offset_ - from),
+      POSIX_FADV_DONTNEED);
+    dropped_offset_ = offset_;
+  }
+#endif
+
+  return {buffer_.get(), count};
+}
+
+DMITIGR_INTERNAL_INLINE void Sequential_reader::switch_to_buffered_mode()
+{
+#ifdef O_DIRECT
+  if (is_direct_) {
+    const int flags = ::fcntl(fd_, F_GETFL);
+    if (flags < 0 || ::fcntl(fd_, F_SETFL, flags & ~O_DIRECT) < 0)
+      throw_sequential_reader_error__("read()");
+    is_direct_ = false;
+  }
+#endif
+#ifdef POSIX_FADV_SEQUENTIAL
+  ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  dropped_offset_ = offset_;
+}
+
+#endif  // _WIN32
+
 DMITIGR_INTERNAL_INLINE std::filesystem::path relative_root_path(const std::filesystem::path& indicator)
 {
   auto path = std::filesystem::current_path();
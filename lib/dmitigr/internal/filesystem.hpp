@@ -9,10 +9,24 @@
 
 #include "dmitigr/internal/filesystem_experimental.hpp"
 
+#include <cstddef>
+#include <cstdint>
+#include <exception>
 #include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+namespace dmitigr::internal::os::io {
+class Async_io;
+} // namespace dmitigr::internal::os::io
+
 namespace dmitigr::internal::filesystem {
 
 /**
@@ -32,6 +46,343 @@ DMITIGR_INTERNAL_API std::vector<std::filesystem::path> files_by_extension(const
 
 // -----------------------------------------------------------------------------
 
+/**
+ * @internal
+ *
+ * @brief Represents a matcher of the paths against the set of glob patterns.
+ *
+ * The following wildcards are supported by the patterns:
+ *   - "*" matches any sequence of characters except the directory separator;
+ *   - "?" matches any single character except the directory separator;
+ *   - "[...]" matches any single character from the set (the set can include
+ *   ranges, like "a-z", and be negated by the leading "!").
+ *
+ * The leading dot of the filename is not special, i.e. the wildcards match it
+ * like any other character (so "*.conf" matches ".conf" as well).
+ *
+ * The patterns which contain the directory separator are matched against the
+ * relative path, the rest are matched against the filename only. The patterns
+ * of the form "*.ext" are matched by the lookup of the extension instead of
+ * the glob matching.
+ *
+ * @see files_by_matcher().
+ */
+class Path_matcher {
+public:
+  /**
+   * @brief Adds the rule to classify the files matching the `pattern` as `category`.
+   *
+   * If a path matches several rules, the rule added first wins.
+   */
+  DMITIGR_INTERNAL_API void add(std::string_view pattern, std::size_t category);
+
+  /**
+   * @brief Adds the rule to skip the subtrees of the directories matching the `pattern`.
+   */
+  DMITIGR_INTERNAL_API void exclude_directory(std::string_view pattern);
+
+  /**
+   * @returns The category of the first rule which matches the `relative_path`,
+   * or `std::nullopt` if there is no match.
+   */
+  DMITIGR_INTERNAL_API std::optional<std::size_t> match(std::string_view relative_path) const;
+
+  /**
+   * @returns `true` if the `relative_path` matches any of the rules of
+   * directory exclusion.
+   */
+  DMITIGR_INTERNAL_API bool is_directory_excluded(std::string_view relative_path) const;
+
+  /** @returns The maximum category plus one, or `0` if there are no rules. */
+  std::size_t category_count() const noexcept
+  {
+    return category_count_;
+  }
+
+private:
+  struct Rule final {
+    std::size_t order{};
+    std::size_t category{};
+    std::string pattern;
+    bool is_path_pattern{};
+  };
+
+  /** The rules of the form "*.ext" by extension. */
+  std::map<std::string, Rule, std::less<>> extension_rules_; // transparent to look up by views
+
+  /** The rules that require the glob matching. */
+  std::vector<Rule> glob_rules_;
+
+  /** The rules of directory exclusion. */
+  std::vector<Rule> exclusion_rules_;
+
+  std::size_t rule_count_{};
+  std::size_t category_count_{};
+};
+
+/**
+ * @internal
+ *
+ * @returns The vector of the vectors of paths of the regular files classified
+ * by the `matcher` during the single traversal of the `root` directory. The
+ * `i`-th element of the result contains the paths of the category `i`.
+ *
+ * @param root - The search root.
+ * @param matcher - The matcher. The paths are matched relative to the `root`.
+ * @param recursive - if `true` then do the recursive search.
+ */
+DMITIGR_INTERNAL_API std::vector<std::vector<std::filesystem::path>> files_by_matcher(const std::filesystem::path& root,
+  const Path_matcher& matcher, bool recursive);
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @internal
+ *
+ * @brief Represents a lazy input range of the directory entries.
+ *
+ * The entries are yielded one at a time in the order of the directory traversal.
+ * Only the entries for which the filter returns `true` are yielded.
+ */
+class Entry_range {
+public:
+  /** Represents a filter of the directory entries. */
+  using Filter = std::function<bool (const std::filesystem::directory_entry&)>;
+
+  /**
+   * @brief Represents an input iterator of the range.
+   */
+  class Iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = std::filesystem::directory_entry;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    /** Constructs the end iterator. */
+    Iterator() = default;
+
+    reference operator*() const
+    {
+      return *range_->iterator_;
+    }
+
+    pointer operator->() const
+    {
+      return &**this;
+    }
+
+    Iterator& operator++()
+    {
+      if (!range_->next())
+        range_ = nullptr;
+      return *this;
+    }
+
+    Iterator operator++(int)
+    {
+      auto result = *this;
+      ++*this;
+      return result;
+    }
+
+    friend bool operator==(const Iterator& lhs, const Iterator& rhs) noexcept
+    {
+      return lhs.range_ == rhs.range_;
+    }
+
+    friend bool operator!=(const Iterator& lhs, const Iterator& rhs) noexcept
+    {
+      return !(lhs == rhs);
+    }
+
+  private:
+    friend Entry_range;
+
+    explicit Iterator(Entry_range* const range)
+      : range_{range}
+    {}
+
+    Entry_range* range_{};
+  };
+
+  /**
+   * @brief The constructor.
+   *
+   * @param root - The search root. If it's not a directory the range is empty.
+   * @param filter - The filter of the entries. (Empty filter accepts all entries.)
+   * @param recursive - if `true` then do the recursive traversal.
+   * @param prune - The predicate which is called for each entry (regardless
+   * of the `filter`) in case of recursive traversal. If it returns `true` for
+   * a directory, then the whole subtree of that directory is skipped.
+   */
+  DMITIGR_INTERNAL_API Entry_range(const std::filesystem::path& root, Filter filter, bool recursive, Filter prune = {});
+
+  /**
+   * @returns The iterator to the first entry that satisfies the filter.
+   *
+   * @remarks Since this is an input range it can be traversed only once.
+   */
+  DMITIGR_INTERNAL_API Iterator begin();
+
+  /** @returns The end iterator. */
+  Iterator end() const noexcept
+  {
+    return Iterator{};
+  }
+
+private:
+  /**
+   * @brief Advances to the next entry that satisfies the filter.
+   *
+   * @returns `false` if the end of the traversal is reached.
+   */
+  bool next();
+
+  /**
+   * @brief Skips the entries that do not satisfy the filter starting from the current one.
+   *
+   * @returns `false` if the end of the traversal is reached.
+   */
+  bool settle();
+
+  /** Moves to the next entry of the traversal. */
+  void step();
+
+  Filter filter_;
+  Filter prune_;
+  bool recursive_{};
+  bool is_started_{};
+  std::filesystem::recursive_directory_iterator iterator_;
+};
+
+/**
+ * @internal
+ *
+ * @returns The lazy range of the entries of the `root` directory.
+ *
+ * @see Entry_range.
+ */
+inline Entry_range entries(const std::filesystem::path& root, Entry_range::Filter filter = {},
+  const bool recursive = true, Entry_range::Filter prune = {})
+{
+  return Entry_range{root, std::move(filter), recursive, std::move(prune)};
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @internal
+ *
+ * @brief Represents a lazy input range of the lines of a file.
+ *
+ * The lines are read one at a time, so the memory consumption doesn't depend
+ * on the size of the file. If the file cannot be opened the range is empty.
+ */
+class Line_range {
+public:
+  /**
+   * @brief Represents an input iterator of the range.
+   */
+  class Iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = std::string;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    /** Constructs the end iterator. */
+    Iterator() = default;
+
+    reference operator*() const
+    {
+      return range_->line_;
+    }
+
+    pointer operator->() const
+    {
+      return &range_->line_;
+    }
+
+    Iterator& operator++()
+    {
+      if (!range_->next())
+        range_ = nullptr;
+      return *this;
+    }
+
+    Iterator operator++(int)
+    {
+      auto result = *this;
+      ++*this;
+      return result;
+    }
+
+    friend bool operator==(const Iterator& lhs, const Iterator& rhs) noexcept
+    {
+      return lhs.range_ == rhs.range_;
+    }
+
+    friend bool operator!=(const Iterator& lhs, const Iterator& rhs) noexcept
+    {
+      return !(lhs == rhs);
+    }
+
+  private:
+    friend Line_range;
+
+    explicit Iterator(Line_range* const range)
+      : range_{range}
+    {}
+
+    Line_range* range_{};
+  };
+
+  /** The constructor. */
+  DMITIGR_INTERNAL_API explicit Line_range(const std::filesystem::path& path);
+
+  /**
+   * @returns The iterator to the first line.
+   *
+   * @remarks Since this is an input range it can be traversed only once.
+   */
+  DMITIGR_INTERNAL_API Iterator begin();
+
+  /** @returns The end iterator. */
+  Iterator end() const noexcept
+  {
+    return Iterator{};
+  }
+
+private:
+  /**
+   * @brief Reads the next line.
+   *
+   * @returns `false` if there are no more lines.
+   */
+  bool next();
+
+  std::ifstream stream_;
+  std::string line_;
+  bool is_started_{};
+};
+
+/**
+ * @internal
+ *
+ * @returns The lazy range of the lines of the file denoted by the given `path`.
+ *
+ * @see Line_range.
+ */
+inline Line_range lines(const std::filesystem::path& path)
+{
+  return Line_range{path};
+}
+
+// -----------------------------------------------------------------------------
+
 /**
  * @internal
  *
@@ -41,9 +392,7 @@ template<typename Pred>
 std::vector<std::string> read_lines_to_vector_if(const std::filesystem::path& path, Pred pred)
 {
   std::vector<std::string> result;
-  std::string line;
-  std::ifstream lines{path};
-  while (getline(lines, line)) {
+  for (auto&& line : lines(path)) {
     if (pred(line))
       result.push_back(line);
   }
@@ -70,6 +419,431 @@ DMITIGR_INTERNAL_API std::string read_to_string(const std::filesystem::path& pat
 
 // -----------------------------------------------------------------------------
 
+/**
+ * @internal
+ *
+ * @brief Represents a callback of load_files().
+ *
+ * The callback accepts the index of the path in the vector of paths passed to
+ * load_files(), the content of the file, and the error occurred while loading.
+ * If the `error` is not null, then the `content` is empty.
+ */
+using Load_callback = std::function<void (std::size_t index, std::string&& content, std::exception_ptr error)>;
+
+/**
+ * @internal
+ *
+ * @brief Reads the entire files denoted by `paths` concurrently.
+ *
+ * The errors are reported per file via the `callback` and do not abort
+ * the batch.
+ *
+ * @param paths - The paths of the files to read.
+ * @param callback - The callback to be called once per each file. The calls
+ * are serialized, but the order of the calls is unspecified.
+ * @param concurrency - The maximum number of threads to use, or `0` to use
+ * the value of `std::thread::hardware_concurrency()`.
+ *
+ * @remarks Exceptions thrown by the `callback` abort the batch and propagated
+ * to the caller.
+ */
+DMITIGR_INTERNAL_API void load_files(const std::vector<std::filesystem::path>& paths,
+  const Load_callback& callback, std::size_t concurrency = 0);
+
+/**
+ * @internal
+ *
+ * @brief Represents the contents of the files loaded into the single buffer.
+ *
+ * @see load_files_to_arena().
+ */
+class Loaded_files {
+public:
+  /** @returns The number of files. */
+  std::size_t size() const noexcept
+  {
+    return slots_.size();
+  }
+
+  /**
+   * @returns The content of the `index`-th file, or empty view if the file
+   * was not loaded.
+   */
+  std::string_view content(const std::size_t index) const
+  {
+    const auto& slot = slots_.at(index);
+    return std::string_view{buffer_.data() + slot.offset, slot.size};
+  }
+
+  /**
+   * @returns The error occurred while loading the `index`-th file, or null if
+   * the file was loaded successfully.
+   */
+  const std::exception_ptr& error(const std::size_t index) const
+  {
+    return slots_.at(index).error;
+  }
+
+  /** @returns The buffer with the contents of all of the loaded files. */
+  const std::string& buffer() const noexcept
+  {
+    return buffer_;
+  }
+
+private:
+  friend Loaded_files load_files_to_arena(const std::vector<std::filesystem::path>&, std::size_t);
+#ifndef _WIN32
+  friend Loaded_files load_files_to_arena(const std::vector<std::filesystem::path>&, os::io::Async_io&);
+#endif
+
+  struct Slot final {
+    std::size_t offset{};
+    std::size_t size{};
+    std::exception_ptr error;
+  };
+
+  std::string buffer_;
+  std::vector<Slot> slots_;
+
+  /**
+   * @brief Determines the sizes of the files and distributes the buffer
+   * among them.
+   */
+  void allocate(const std::vector<std::filesystem::path>& paths, std::size_t concurrency);
+};
+
+/**
+ * @internal
+ *
+ * @brief Reads the entire files denoted by `paths` concurrently into the
+ * single buffer.
+ *
+ * The sizes of the files are determined first, so the files which are
+ * changed in size while loading are reported as failed.
+ *
+ * @param paths - The paths of the files to read.
+ * @param concurrency - The maximum number of threads to use, or `0` to use
+ * the value of `std::thread::hardware_concurrency()`.
+ */
+DMITIGR_INTERNAL_API Loaded_files load_files_to_arena(const std::vector<std::filesystem::path>& paths,
+  std::size_t concurrency = 0);
+
+#ifndef _WIN32
+
+/**
+ * @internal
+ *
+ * @brief Similar to load_files_to_arena(paths, concurrency) but reads the
+ * files by using the asynchronous I/O engine `aio`, so up to the
+ * `aio.queue_depth()` reads are in flight at a time.
+ *
+ * @par Requires
+ * `!aio.pending_count()`, since every completion reaped from `aio` is taken
+ * as the completion of the request of this function.
+ *
+ * @throws `std::logic_error` if the requirement above is not met.
+ */
+DMITIGR_INTERNAL_API Loaded_files load_files_to_arena(const std::vector<std::filesystem::path>& paths,
+  os::io::Async_io& aio);
+
+#endif  // _WIN32
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @internal
+ *
+ * @returns The fingerprint (XXH64 hash) of the content of the file denoted
+ * by the given `path`.
+ *
+ * @remarks The file is read by large blocks, so the memory consumption
+ * doesn't depend on the size of the file.
+ */
+DMITIGR_INTERNAL_API std::uint64_t content_fingerprint(const std::filesystem::path& path);
+
+/**
+ * @internal
+ *
+ * @brief Represents a fingerprint of the set of files.
+ *
+ * @see directory_fingerprint().
+ */
+struct Directory_fingerprint final {
+  /** The fingerprint of the whole set of files. */
+  std::uint64_t value{};
+
+  /** The paths (relative to the root) and fingerprints of the files sorted by path. */
+  std::vector<std::pair<std::filesystem::path, std::uint64_t>> files;
+};
+
+/**
+ * @internal
+ *
+ * @returns The fingerprint of the files found by `files_by_extension(root, extension, recursive)`.
+ *
+ * The fingerprints of the files are computed concurrently. The resulting
+ * fingerprint is the hash of the sequence of the relative paths of the files
+ * and their fingerprints, so it's changed if any of the files are changed,
+ * added, removed or renamed. To find out which files are changed, compare
+ * the `files` of the two results.
+ *
+ * @param concurrency - The maximum number of threads to use, or `0` to use
+ * the value of `std::thread::hardware_concurrency()`.
+ */
+DMITIGR_INTERNAL_API Directory_fingerprint directory_fingerprint(const std::filesystem::path& root,
+  const std::filesystem::path& extension, bool recursive, std::size_t concurrency = 0);
+
+// -----------------------------------------------------------------------------
+
+#ifndef _WIN32
+
+/**
+ * @internal
+ *
+ * @brief Copies the content of the file `from` to the file `to`.
+ *
+ * The data is copied inside the kernel if possible. The file `to` is created
+ * with the permissions of the file `from` (modified by the umask) if it does
+ * not exists, or truncated otherwise.
+ *
+ * @returns The number of bytes copied.
+ *
+ * @see os::io::transfer().
+ */
+DMITIGR_INTERNAL_API std::uintmax_t copy_file_content(const std::filesystem::path& from, const std::filesystem::path& to);
+
+/**
+ * @internal
+ *
+ * @brief Similar to copy_file_content() but copies only the regions of data
+ * of the file `from` and recreates the holes in the file `to`.
+ *
+ * @returns The number of bytes of data copied.
+ *
+ * @see os::io::copy_sparse().
+ */
+DMITIGR_INTERNAL_API std::uintmax_t copy_sparse_file_content(const std::filesystem::path& from,
+  const std::filesystem::path& to);
+
+#endif  // _WIN32
+
+// -----------------------------------------------------------------------------
+
+#ifndef _WIN32
+
+/**
+ * @internal
+ *
+ * @brief Represents a buffered writer of a file.
+ *
+ * The data is accumulated in the large aligned buffer. The data which doesn't
+ * fit into the buffer is written along with the buffered data by the single
+ * vectored write.
+ *
+ * In the atomic mode the data is written to the temporary file in the same
+ * directory, and commit() replaces the target file with it, so the target
+ * file is never left half-written.
+ */
+class File_writer {
+public:
+  /**
+   * @brief Represents the options of the writer.
+   */
+  struct Options final {
+    /** The size of the buffer. (Rounded up to the multiple of the page size.) */
+    std::size_t buffer_size{1024 * 1024};
+
+    /** The expected final size of the file to preallocate the space for, or `0`. */
+    std::uintmax_t expected_size{};
+
+    /** The indicator of the atomic mode. */
+    bool is_atomic{};
+  };
+
+  /**
+   * @brief Opens the file for writing with the default options.
+   *
+   * @see File_writer(const std::filesystem::path&, const Options&).
+   */
+  DMITIGR_INTERNAL_API explicit File_writer(const std::filesystem::path& path);
+
+  /**
+   * @brief Opens the file for writing.
+   *
+   * In the non-atomic mode the file is truncated. In the atomic mode the
+   * temporary file is created instead.
+   */
+  DMITIGR_INTERNAL_API File_writer(const std::filesystem::path& path, const Options& options);
+
+  /**
+   * @brief Closes the file.
+   *
+   * In the non-atomic mode the buffered data is written to the file, and the
+   * errors are ignored. In the atomic mode the temporary file is removed
+   * unless commit() is called.
+   */
+  DMITIGR_INTERNAL_API ~File_writer();
+
+  /** Non copy-constructible. */
+  File_writer(const File_writer&) = delete;
+
+  /** Non copy-assignable. */
+  File_writer& operator=(const File_writer&) = delete;
+
+  /**
+   * @brief Writes the data.
+   *
+   * @par Requires
+   * `!is_committed()`.
+   */
+  DMITIGR_INTERNAL_API void write(const void* data, std::size_t size);
+
+  /** @overload */
+  void write(const std::string_view data)
+  {
+    write(data.data(), data.size());
+  }
+
+  /**
+   * @brief Writes the buffered data to the file.
+   *
+   * @par Requires
+   * `!is_committed()`.
+   */
+  DMITIGR_INTERNAL_API void flush();
+
+  /**
+   * @brief Writes the buffered data to the file, synchronizes the file with
+   * the storage device and closes it. In the atomic mode, replaces the target
+   * file with the temporary file.
+   *
+   * @par Requires
+   * `!is_committed()`.
+   */
+  DMITIGR_INTERNAL_API void commit();
+
+  /** @returns The path of the target file. */
+  const std::filesystem::path& path() const noexcept
+  {
+    return path_;
+  }
+
+  /** @returns The number of bytes written (including the buffered ones). */
+  std::uintmax_t size() const noexcept
+  {
+    return size_;
+  }
+
+  /** @returns `true` if commit() has been called successfully. */
+  bool is_committed() const noexcept
+  {
+    return is_committed_;
+  }
+
+private:
+  std::filesystem::path path_;
+  std::filesystem::path temp_path_;
+  int fd_{-1};
+  bool is_committed_{};
+  std::unique_ptr<char, void(*)(void*)> buffer_;
+  std::size_t buffer_capacity_{};
+  std::size_t buffer_size_{};
+  std::uintmax_t size_{};
+
+  void write_buffer_and(const void* data, std::size_t size);
+};
+
+/**
+ * @internal
+ *
+ * @brief Represents a sequential reader of a (large) file which doesn't pollute
+ * the page cache.
+ *
+ * In the direct mode the file is read with `O_DIRECT` into the aligned buffer
+ * bypassing the page cache. If the direct I/O is unsupported by the filesystem,
+ * or if the file position becomes unaligned (because of the short read), the
+ * reader switches to the buffered mode, in which the kernel is advised about
+ * the sequential access, and the pages behind the cursor are dropped from the
+ * page cache.
+ */
+class Sequential_reader {
+public:
+  /**
+   * @brief Represents the options of the reader.
+   */
+  struct Options final {
+    /** The size of the buffer. (Rounded up to the multiple of the page size.) */
+    std::size_t buffer_size{1024 * 1024};
+
+    /** The indicator of the attempt to use the direct I/O. */
+    bool is_direct{true};
+
+    /** The indicator of dropping the pages behind the cursor in the buffered mode. */
+    bool is_cache_dropped{true};
+  };
+
+  /**
+   * @brief Opens the file for reading with the default options.
+   *
+   * @see Sequential_reader(const std::filesystem::path&, const Options&).
+   */
+  DMITIGR_INTERNAL_API explicit Sequential_reader(const std::filesystem::path& path);
+
+  /** Opens the file for reading. */
+  DMITIGR_INTERNAL_API Sequential_reader(const std::filesystem::path& path, const Options& options);
+
+  /** Closes the file. */
+  DMITIGR_INTERNAL_API ~Sequential_reader();
+
+  /** Non copy-constructible. */
+  Sequential_reader(const Sequential_reader&) = delete;
+
+  /** Non copy-assignable. */
+  Sequential_reader& operator=(const Sequential_reader&) = delete;
+
+  /**
+   * @brief Reads the next chunk of the file.
+   *
+   * @returns The view of the chunk which is valid until the next call, or
+   * an empty view at the end of the file.
+   */
+  DMITIGR_INTERNAL_API std::string_view read();
+
+  /** @returns The path of the file. */
+  const std::filesystem::path& path() const noexcept
+  {
+    return path_;
+  }
+
+  /** @returns The number of bytes read. */
+  std::uintmax_t offset() const noexcept
+  {
+    return offset_;
+  }
+
+  /** @returns `true` if the file is currently read with the direct I/O. */
+  bool is_direct() const noexcept
+  {
+    return is_direct_;
+  }
+
+private:
+  std::filesystem::path path_;
+  int fd_{-1};
+  std::unique_ptr<char, void(*)(void*)> buffer_;
+  std::size_t buffer_capacity_{};
+  std::uintmax_t offset_{};
+  std::uintmax_t dropped_offset_{};
+  bool is_direct_{};
+  bool is_cache_dropped_{};
+
+  void switch_to_buffered_mode();
+};
+
+#endif  // _WIN32
+
+// -----------------------------------------------------------------------------
+
 /**
  * @internal
  *
@@ -0,0 +1,177 @@
+// -*- C++ -*-
+// Copyright (C) Dmitry Igrishin
+// For conditions of distribution and use, see files LICENSE.txt or internal.hpp
+
+#ifndef DMITIGR_INTERNAL_HASH_HPP
+#define DMITIGR_INTERNAL_HASH_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace dmitigr::internal::hash {
+
+/**
+ * @internal
+ *
+ * @brief Represents the streaming implementation of the XXH64 hash function.
+ *
+ * The input is consumed by 32-byte stripes by four independent accumulators,
+ * which allows the compiler to keep them in registers (or vectorize them).
+ * The results are compatible with the reference implementation of XXH64.
+ */
+class Xxh64 final {
+public:
+  /** The constructor. */
+  explicit constexpr Xxh64(const std::uint64_t seed = 0) noexcept
+    : acc_{seed + prime1 + prime2, seed + prime2, seed, seed - prime1}
+    , seed_{seed}
+  {}
+
+  /** Consumes the `size` bytes pointed by `data`. */
+  void update(const void* const data, std::size_t size) noexcept
+  {
+    auto* input = static_cast<const unsigned char*>(data);
+    total_size_ += size;
+
+    // Complete the pending stripe.
+    if (pending_size_) {
+      const auto count = std::min(size, stripe_size - pending_size_);
+      std::memcpy(pending_ + pending_size_, input, count);
+      pending_size_ += count;
+      input += count;
+      size -= count;
+      if (pending_size_ < stripe_size)
+        return;
+      consume_stripe(pending_);
+      pending_size_ = 0;
+    }
+
+    for (; size >= stripe_size; input += stripe_size, size -= stripe_size)
+      consume_stripe(input);
+
+    if (size) {
+      std::memcpy(pending_, input, size);
+      pending_size_ = size;
+    }
+  }
+
+  /** @overload */
+  void update(const std::string_view data) noexcept
+  {
+    update(data.data(), data.size());
+  }
+
+  /** @returns The hash of the data consumed so far. */
+  std::uint64_t digest() const noexcept
+  {
+    std::uint64_t result;
+    if (total_size_ >= stripe_size) {
+      result = rotl(acc_[0], 1) + rotl(acc_[1], 7) + rotl(acc_[2], 12) + rotl(acc_[3], 18);
+      for (const auto acc : acc_)
+        result = (result ^ round(0, acc)) * prime1 + prime4;
+    } else
+      result = seed_ + prime5;
+    result += total_size_;
+
+    const unsigned char* p = pending_;
+    auto size = pending_size_;
+    for (; size >= 8; p += 8, size -= 8)
+      result = rotl(result ^ round(0, read64(p)), 27) * prime1 + prime4;
+    if (size >= 4) {
+      result = rotl(result ^ (read32(p) * prime1), 23) * prime2 + prime3;
+      p += 4;
+      size -= 4;
+    }
+    for (; size; ++p, --size)
+      result = rotl(result ^ (*p * prime5), 11) * prime1;
+
+    result ^= result >> 33;
+    result *= prime2;
+    result ^= result >> 29;
+    result *= prime3;
+    result ^= result >> 32;
+    return result;
+  }
+
+private:
+  static constexpr std::size_t stripe_size = 32;
+  static constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+  static constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+  static constexpr std::uint64_t prime3 = 0x165667B19E3779F9ULL;
+  static constexpr std::uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+  static constexpr std::uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+  std::uint64_t acc_[4];
+  std::uint64_t seed_{};
+  std::uint64_t total_size_{};
+  unsigned char pending_[stripe_size]{};
+  std::size_t pending_size_{};
+
+  static constexpr std::uint64_t rotl(const std::uint64_t value, const int count) noexcept
+  {
+    return (value << count) | (value >> (64 - count));
+  }
+
+  static constexpr std::uint64_t round(std::uint64_t acc, const std::uint64_t input) noexcept
+  {
+    acc += input * prime2;
+    return rotl(acc, 31) * prime1;
+  }
+
+  static std::uint64_t read64(const unsigned char* const p) noexcept
+  {
+    std::uint64_t result;
+    std::memcpy(&result, p, sizeof(result));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    result = __builtin_bswap64(result);
+#endif
+    return result;
+  }
+
+  static std::uint64_t read32(const unsigned char* const p) noexcept
+  {
+    std::uint32_t result;
+    std::memcpy(&result, p, sizeof(result));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    result = __builtin_bswap32(result);
+#endif
+    return result;
+  }
+
+  void consume_stripe(const unsigned char* const p) noexcept
+  {
+    acc_[0] = round(acc_[0], read64(p));
+    acc_[1] = round(acc_[1], read64(p + 8));
+    acc_[2] = round(acc_[2], read64(p + 16));
+    acc_[3] = round(acc_[3], read64(p + 24));
+  }
+};
+
+/**
+ * @internal
+ *
+ * @returns The XXH64 hash of the `size` bytes pointed by `data`.
+ */
+inline std::uint64_t xxh64(const void* const data, const std::size_t size, const std::uint64_t seed = 0) noexcept
+{
+  Xxh64 result{seed};
+  result.update(data, size);
+  return result.digest();
+}
+
+/**
+ * @internal
+ *
+ * @overload
+ */
+inline std::uint64_t xxh64(const std::string_view data, const std::uint64_t seed = 0) noexcept
+{
+  return xxh64(data.data(), data.size(), seed);
+}
+
+} // namespace dmitigr::internal::hash
+
+#endif  // DMITIGR_INTERNAL_HASH_HPP
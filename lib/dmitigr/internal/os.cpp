@@ -5,9 +5,23 @@
 #include "dmitigr/internal/debug.hpp"
 #include "dmitigr/internal/os.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
 #include <system_error>
+#include <thread>
+#include <utility>
 
 #ifdef _WIN32
 
@@ -36,10 +50,31 @@
 
 #else // Unix
 
+#include <pthread.h>
 #include <pwd.h>
+#include <sched.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+#endif
+
+#ifndef _WIN32
+extern char** environ;
+#endif
+
+#if defined(DMITIGR_INTERNAL_CLOCK_X86) && !defined(_MSC_VER)
+#include <cpuid.h>
 #endif
 
 #include "dmitigr/internal/implementation_header.hpp"
@@ -143,41 +178,1668 @@ DMITIGR_INTERNAL_INLINE std::optional<std::string> environment_variable(const st
 }
 
 // -----------------------------------------------------------------------------
+// Process context
 
-namespace io {
+DMITIGR_INTERNAL_INLINE Process_context::Process_context()
+{
+  // Collect the environment into the single storage.
+#ifdef _WIN32
+  if (char* const block = ::GetEnvironmentStringsA()) {
+    for (const char* entry = block; *entry; entry += std::strlen(entry) + 1)
+      environment_.append(entry).push_back('\0');
+    ::FreeEnvironmentStringsA(block);
+  }
+#else
+  for (char** entry = environ; entry && *entry; ++entry)
+    environment_.append(*entry).push_back('\0');
+#endif
+
+  // Index the storage. (The first entry wins, as with getenv().)
+  for (std::size_t pos{}; pos < environment_.size();) {
+    const std::string_view entry{environment_.c_str() + pos};
+    // The name of a Windows variable may start with '='.
+    if (const auto eq = entry.find('=', 1); eq != std::string_view::npos)
+      variables_.emplace(entry.substr(0, eq), entry.substr(eq + 1));
+    pos += entry.size() + 1;
+  }
+
+#ifdef _WIN32
+  try {
+    username_ = current_username();
+  } catch (...) {}
+  if (const auto home = environment_variable("USERPROFILE"))
+    home_directory_ = *home;
+#else
+  const uid_t uid = geteuid();
+  user_id_ = uid;
+  struct passwd pwd;
+  struct passwd* pwd_ptr{};
+  std::vector<char> buf(16384);
+  int err;
+  while ((err = getpwuid_r(uid, &pwd, buf.data(), buf.size(), &pwd_ptr)) == ERANGE)
+    buf.resize(buf.size() * 2);
+  if (!err && pwd_ptr) {
+    username_ = pwd.pw_name;
+    home_directory_ = pwd.pw_dir;
+  }
+  if (home_directory_.empty()) {
+    if (const auto home = environment_variable("HOME"))
+      home_directory_ = *home;
+  }
+#endif
+}
+
+namespace {
+
+/**
+ * @internal
+ *
+ * @brief The published snapshots of the process context.
+ */
+struct Process_contexts__ final {
+  std::atomic<std::uint64_t> generation{};
+  std::mutex mutex; // guards current
+  std::shared_ptr<const Process_context> current;
+};
+
+inline Process_contexts__& process_contexts__()
+{
+  static Process_contexts__ result;
+  return result;
+}
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE std::shared_ptr<const Process_context> Process_context::current()
+{
+  auto& contexts = process_contexts__();
+  const std::lock_guard lg{contexts.mutex};
+  if (!contexts.current) {
+    contexts.current.reset(new Process_context);
+    contexts.generation.fetch_add(1, std::memory_order_release);
+  }
+  return contexts.current;
+}
+
+DMITIGR_INTERNAL_INLINE std::shared_ptr<const Process_context> Process_context::refresh()
+{
+  std::shared_ptr<const Process_context> result{new Process_context};
+  auto& contexts = process_contexts__();
+  const std::lock_guard lg{contexts.mutex};
+  contexts.current = result;
+  contexts.generation.fetch_add(1, std::memory_order_release);
+  return result;
+}
+
+DMITIGR_INTERNAL_INLINE std::uint64_t Process_context::generation() noexcept
+{
+  return process_contexts__().generation.load(std::memory_order_acquire);
+}
+
+DMITIGR_INTERNAL_INLINE std::optional<std::string_view>
+Process_context::environment_variable(const std::string_view name) const noexcept
+{
+  if (const auto i = variables_.find(name); i != variables_.cend())
+    return i->second;
+  else
+    return std::nullopt;
+}
+
+// -----------------------------------------------------------------------------
+// CPU topology
+
+namespace {
+
+#ifdef __linux__
+
+inline std::optional<std::string> read_first_line__(const std::string& path)
+{
+  std::ifstream stream{path};
+  std::string result;
+  if (stream && std::getline(stream, result))
+    return result;
+  else
+    return std::nullopt;
+}
+
+inline std::optional<long long> read_integer__(const std::string& path)
+{
+  if (const auto line = read_first_line__(path)) {
+    char* end{};
+    errno = 0;
+    const long long result = std::strtoll(line->c_str(), &end, 10);
+    if (!errno && end != line->c_str())
+      return result;
+  }
+  return std::nullopt;
+}
+
+/*
+ * Parses the list in the format of `/sys/devices/system/cpu/online`, for
+ * example: "0-3,8,10-11".
+ */
+inline std::vector<unsigned> parse_cpu_list__(const std::string& list)
+{
+  std::vector<unsigned> result;
+  const char* p = list.c_str();
+  while (*p) {
+    char* end{};
+    const unsigned long first = std::strtoul(p, &end, 10);
+    if (end == p)
+      break;
+    unsigned long last = first;
+    p = end;
+    if (*p == '-') {
+      last = std::strtoul(p + 1, &end, 10);
+      if (end == p + 1)
+        break;
+      p = end;
+    }
+    for (auto i = first; i <= last; ++i)
+      result.push_back(static_cast<unsigned>(i));
+    if (*p != ',')
+      break;
+    ++p;
+  }
+  return result;
+}
+
+/*
+ * Parses the cache size in the format of `/sys/devices/system/cpu/cpuN/cache`,
+ * for example: "32K".
+ */
+inline std::size_t parse_cache_size__(const std::string& str)
+{
+  char* end{};
+  std::size_t result = std::strtoull(str.c_str(), &end, 10);
+  switch (*end) {
+  case 'K': result *= 1024; break;
+  case 'M': result *= 1024 * 1024; break;
+  case 'G': result *= 1024 * 1024 * 1024; break;
+  }
+  return result;
+}
+
+/*
+ * @returns The CPU quota (in CPUs) of the control group of the current
+ * process, or `std::nullopt` if the quota is unlimited or unknown.
+ */
+inline std::optional<double> cgroup_cpu_quota__()
+{
+  std::ifstream stream{"/proc/self/cgroup"};
+  std::optional<double> result;
+  const auto apply = [&result](const long long quota, const long long period)
+  {
+    if (quota > 0 && period > 0) {
+      const double value = double(quota) / double(period);
+      if (!result || value < *result)
+        result = value;
+    }
+  };
+  for (std::string line; std::getline(stream, line);) {
+    // Format: "hierarchy-ID:controller-list:cgroup-path".
+    const auto colon1 = line.find(':');
+    const auto colon2 = colon1 != std::string::npos ? line.find(':', colon1 + 1) : colon1;
+    if (colon2 == std::string::npos)
+      continue;
+    const auto controllers = line.substr(colon1 + 1, colon2 - colon1 - 1);
+    std::string path = line.substr(colon2 + 1);
+    if (controllers.empty()) {
+      // cgroup v2. The limit of each ancestor applies as well.
+      while (true) {
+        if (const auto max = read_first_line__("/sys/fs/cgroup" + path + "/cpu.max")) {
+          if (max->compare(0, 3, "max")) {
+            char* end{};
+            const long long quota = std::strtoll(max->c_str(), &end, 10);
+            apply(quota, std::strtoll(end, nullptr, 10));
+          }
+        }
+        if (path.empty() || path == "/")
+          break;
+        path.erase(path.rfind('/'));
+      }
+    } else if (("," + controllers + ",").find(",cpu,") != std::string::npos) {
+      // cgroup v1.
+      for (const char* const mount : {"/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct"}) {
+        for (const auto& dir : {std::string{mount} + path, std::string{mount}}) {
+          const auto quota = read_integer__(dir + "/cpu.cfs_quota_us");
+          const auto period = read_integer__(dir + "/cpu.cfs_period_us");
+          if (quota && period) {
+            apply(*quota, *period);
+            break;
+          }
+        }
+      }
+    }
+  }
+  return result;
+}
+
+#endif
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE std::size_t Cpu_topology::physical_core_count() const
+{
+  std::vector<std::pair<int, int>> cores;
+  cores.reserve(cpus.size());
+  std::size_t unknown_count{};
+  for (const auto& cpu : cpus) {
+    if (cpu.core_id < 0)
+      ++unknown_count;
+    else
+      cores.emplace_back(cpu.package_id, cpu.core_id);
+  }
+  std::sort(begin(cores), end(cores));
+  return std::unique(begin(cores), end(cores)) - begin(cores) + unknown_count;
+}
+
+DMITIGR_INTERNAL_INLINE std::size_t Cpu_topology::available_cpu_count() const noexcept
+{
+  std::size_t result = affinity.empty() ? cpus.size() : affinity.size();
+  if (cpu_quota)
+    result = std::min(result, static_cast<std::size_t>(std::ceil(*cpu_quota)));
+  return std::max<std::size_t>(result, 1);
+}
+
+DMITIGR_INTERNAL_INLINE const Cpu_cache* Cpu_topology::cache(const unsigned cpu,
+  const unsigned level, const std::string_view type) const noexcept
+{
+  for (const auto& cache : caches) {
+    if (cache.level == level && (cache.type == type || cache.type == "Unified") &&
+      std::binary_search(cbegin(cache.cpus), cend(cache.cpus), cpu))
+      return &cache;
+  }
+  return nullptr;
+}
+
+DMITIGR_INTERNAL_INLINE Cpu_topology cpu_topology()
+{
+  Cpu_topology result;
+#ifdef __linux__
+  static const std::string sys_cpu{"/sys/devices/system/cpu/"};
+  std::vector<unsigned> online;
+  if (const auto list = read_first_line__(sys_cpu + "online"))
+    online = parse_cpu_list__(*list);
+
+  for (const auto id : online) {
+    const auto dir = sys_cpu + "cpu" + std::to_string(id) + "/";
+    auto& cpu = result.cpus.emplace_back();
+    cpu.id = id;
+    cpu.core_id = static_cast<int>(read_integer__(dir + "topology/core_id").value_or(-1));
+    cpu.package_id = static_cast<int>(read_integer__(dir + "topology/physical_package_id").value_or(-1));
+    if (const auto list = read_first_line__(dir + "topology/thread_siblings_list"))
+      cpu.siblings = parse_cpu_list__(*list);
+    else
+      cpu.siblings = {id};
+
+    for (unsigned i{};; ++i) {
+      const auto index = dir + "cache/index" + std::to_string(i) + "/";
+      const auto level = read_integer__(index + "level");
+      if (!level)
+        break;
+      Cpu_cache cache;
+      cache.level = static_cast<unsigned>(*level);
+      cache.type = read_first_line__(index + "type").value_or("Unified");
+      cache.size = parse_cache_size__(read_first_line__(index + "size").value_or("0"));
+      cache.line_size = static_cast<std::size_t>(read_integer__(index + "coherency_line_size").value_or(0));
+      if (const auto list = read_first_line__(index + "shared_cpu_list"))
+        cache.cpus = parse_cpu_list__(*list);
+      else
+        cache.cpus = {id};
+      const auto duplicate = std::find_if(cbegin(result.caches), cend(result.caches),
+        [&cache](const auto& c)
+        {
+          return c.level == cache.level && c.type == cache.type && c.cpus == cache.cpus;
+        });
+      if (duplicate == cend(result.caches))
+        result.caches.push_back(std::move(cache));
+    }
+  }
+
+  if (const auto list = read_first_line__("/sys/devices/system/node/online")) {
+    for (const auto id : parse_cpu_list__(*list)) {
+      auto& node = result.nodes.emplace_back();
+      node.id = id;
+      if (const auto cpus = read_first_line__("/sys/devices/system/node/node" +
+          std::to_string(id) + "/cpulist"))
+        node.cpus = parse_cpu_list__(*cpus);
+      for (auto& cpu : result.cpus) {
+        if (std::binary_search(cbegin(node.cpus), cend(node.cpus), cpu.id))
+          cpu.node_id = static_cast<int>(id);
+      }
+    }
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (!sched_getaffinity(0, sizeof(set), &set)) {
+    for (unsigned i{}; i < CPU_SETSIZE; ++i) {
+      if (CPU_ISSET(i, &set))
+        result.affinity.push_back(i);
+    }
+  }
+
+  result.cpu_quota = cgroup_cpu_quota__();
+#endif
+
+  // Fallback.
+  if (result.cpus.empty()) {
+    const unsigned count = std::max(std::thread::hardware_concurrency(), 1U);
+    for (unsigned i{}; i < count; ++i) {
+      auto& cpu = result.cpus.emplace_back();
+      cpu.id = i;
+      cpu.siblings = {i};
+    }
+  }
+  if (result.affinity.empty()) {
+    for (const auto& cpu : result.cpus)
+      result.affinity.push_back(cpu.id);
+  }
+  return result;
+}
+
+DMITIGR_INTERNAL_INLINE void pin_current_thread(const std::vector<unsigned>& cpus)
+{
+  DMITIGR_INTERNAL_ASSERT(!cpus.empty());
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const auto cpu : cpus) {
+    if (cpu >= CPU_SETSIZE)
+      throw std::out_of_range{"dmitigr::internal::os::pin_current_thread(): CPU identifier is out of range"};
+    CPU_SET(cpu, &set);
+  }
+  if (const int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+    throw std::system_error{err, std::system_category(), "dmitigr::internal::os::pin_current_thread()"};
+#elif defined(_WIN32)
+  DWORD_PTR mask{};
+  for (const auto cpu : cpus) {
+    if (cpu >= sizeof(mask) * CHAR_BIT)
+      throw std::out_of_range{"dmitigr::internal::os::pin_current_thread(): CPU identifier is out of range"};
+    mask |= DWORD_PTR{1} << cpu;
+  }
+  if (!::SetThreadAffinityMask(::GetCurrentThread(), mask))
+    throw std::system_error{int(::GetLastError()), std::system_category(), "dmitigr::internal::os::pin_current_thread()"};
+#else
+  (void)cpus;
+  throw std::runtime_error{"dmitigr::internal::os::pin_current_thread(): not supported on this platform"};
+#endif
+}
+
+DMITIGR_INTERNAL_INLINE void pin_current_thread_to_node(const Cpu_topology& topology, const unsigned node)
+{
+  const auto i = std::find_if(cbegin(topology.nodes), cend(topology.nodes),
+    [node](const auto& n) { return n.id == node; });
+  DMITIGR_INTERNAL_ASSERT(i != cend(topology.nodes) && !i->cpus.empty());
+  pin_current_thread(i->cpus);
+}
+
+// -----------------------------------------------------------------------------
+// Monotonic clock
+
+namespace {
+
+/**
+ * @internal
+ *
+ * @returns `true` if the processor reports the invariant TSC.
+ */
+inline bool is_tsc_invariant__() noexcept
+{
+#if defined(DMITIGR_INTERNAL_CLOCK_X86)
+  unsigned regs[4]{};
+#ifdef _MSC_VER
+  int r[4]{};
+  __cpuid(r, 0x80000000);
+  if (static_cast<unsigned>(r[0]) < 0x80000007)
+    return false;
+  __cpuid(r, 0x80000007);
+  std::memcpy(regs, r, sizeof(regs));
+#else
+  if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007 ||
+    !__get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3]))
+    return false;
+#endif
+  if (!(regs[3] & (1U << 8)))
+    return false;
+#ifdef __linux__
+  /*
+   * The kernel switches away from the TSC clocksource when it detects that
+   * the TSC is unreliable (for example, unsynchronized between sockets).
+   */
+  std::ifstream stream{"/sys/devices/system/clocksource/clocksource0/current_clocksource"};
+  std::string source;
+  if (stream >> source && source != "tsc")
+    return false;
+#endif
+  return true;
+#else
+  return false;
+#endif
+}
+
+#ifdef DMITIGR_INTERNAL_CLOCK_X86
+/**
+ * @brief Reads the TSC and the steady clock as close to each other as possible.
+ *
+ * @returns The pair of the TSC and the nanoseconds of the steady clock.
+ */
+inline std::pair<std::uint64_t, std::int64_t> sample_tsc__() noexcept
+{
+  using std::chrono::steady_clock;
+  std::pair<std::uint64_t, std::int64_t> result;
+  std::uint64_t best_window{UINT64_MAX};
+  for (int i{}; i < 16; ++i) {
+    unsigned aux;
+    const auto t0 = __rdtscp(&aux);
+    const auto ns = steady_clock::now().time_since_epoch();
+    const auto t1 = __rdtscp(&aux);
+    if (t1 - t0 < best_window) {
+      best_window = t1 - t0;
+      result.first = t0 + (t1 - t0) / 2;
+      result.second = std::chrono::duration_cast<std::chrono::nanoseconds>(ns).count();
+    }
+  }
+  return result;
+}
+#endif
+
+inline Clock_calibration calibrate_clock__() noexcept
+{
+  Clock_calibration result;
+#ifdef DMITIGR_INTERNAL_CLOCK_X86
+  if (is_tsc_invariant__()) {
+    const auto [ticks0, ns0] = sample_tsc__();
+    std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    const auto [ticks1, ns1] = sample_tsc__();
+    if (ticks1 > ticks0 && ns1 > ns0) {
+      const double ns_per_tick = double(ns1 - ns0) / double(ticks1 - ticks0);
+      // The multiplier must fit into 32 bits (see Clock::scale()).
+      if (ns_per_tick < 1) {
+        result.is_tsc = true;
+        result.base_ticks = ticks1;
+        result.multiplier = static_cast<std::uint64_t>(ns_per_tick * 4294967296.0 + 0.5);
+        result.ticks_per_second = 1e9 / ns_per_tick;
+      }
+    }
+  }
+#endif
+  return result;
+}
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE const Clock_calibration& clock_calibration() noexcept
+{
+  static const Clock_calibration result = calibrate_clock__();
+  return result;
+}
+
+// -----------------------------------------------------------------------------
+// Resource usage
+
+namespace {
+
+#ifdef __linux__
+
+/**
+ * @brief Reads the whole (small) file at `path` into `buffer`.
+ *
+ * @returns The content read, or an empty view on error.
+ */
+inline std::string_view read_proc_file__(const char* const path, char* const buffer,
+  const std::size_t size) noexcept
+{
+  const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return {};
+  std::size_t total{};
+  while (total < size) {
+    const auto n = ::read(fd, buffer + total, size - total);
+    if (n < 0 && errno == EINTR)
+      continue;
+    else if (n <= 0)
+      break;
+    total += static_cast<std::size_t>(n);
+  }
+  ::close(fd);
+  return {buffer, total};
+}
+
+/**
+ * @returns The integer value of the line "key: value" of the `content`, or
+ * `0` if there is no such a line.
+ */
+inline std::int64_t proc_field__(const std::string_view content, const std::string_view key) noexcept
+{
+  for (std::size_t pos{}; pos < content.size();) {
+    auto eol = content.find('\n', pos);
+    if (eol == std::string_view::npos)
+      eol = content.size();
+    const auto line = content.substr(pos, eol - pos);
+    if (line.size() > key.size() && line[key.size()] == ':' &&
+      line.compare(0, key.size(), key) == 0) {
+      std::int64_t result{};
+      for (auto i = key.size() + 1; i < line.size(); ++i) {
+        if (line[i] >= '0' && line[i] <= '9')
+          result = result * 10 + (line[i] - '0');
+        else if (result)
+          break;
+      }
+      return result;
+    }
+    pos = eol + 1;
+  }
+  return 0;
+}
+
+#endif
+
+} // namespace
 
-DMITIGR_INTERNAL_INLINE std::size_t seek(const int fd, long const offset, const Origin whence)
+DMITIGR_INTERNAL_INLINE Resource_usage Resource_usage::operator-(const Resource_usage& rhs) const noexcept
 {
+  Resource_usage result;
+  result.resident_size = resident_size - rhs.resident_size;
+  result.peak_resident_size = peak_resident_size - rhs.peak_resident_size;
+  result.major_faults = major_faults - rhs.major_faults;
+  result.minor_faults = minor_faults - rhs.minor_faults;
+  result.voluntary_context_switches = voluntary_context_switches - rhs.voluntary_context_switches;
+  result.involuntary_context_switches = involuntary_context_switches - rhs.involuntary_context_switches;
+  result.read_chars = read_chars - rhs.read_chars;
+  result.written_chars = written_chars - rhs.written_chars;
+  result.read_bytes = read_bytes - rhs.read_bytes;
+  result.written_bytes = written_bytes - rhs.written_bytes;
+  result.user_time = user_time - rhs.user_time;
+  result.system_time = system_time - rhs.system_time;
+  result.thread_time = thread_time - rhs.thread_time;
+  return result;
+}
+
+DMITIGR_INTERNAL_INLINE Resource_usage resource_usage()
+{
+  Resource_usage result;
 #ifdef _WIN32
-  const auto result = ::_lseek(fd, offset, int(whence));
+  const auto to_ns = [](const FILETIME& ft)
+  {
+    // FILETIME is in 100-nanosecond intervals.
+    return std::chrono::nanoseconds{((std::int64_t(ft.dwHighDateTime) << 32) | ft.dwLowDateTime) * 100};
+  };
+  FILETIME creation, exit, kernel, user;
+  if (!::GetProcessTimes(::GetCurrentProcess(), &creation, &exit, &kernel, &user))
+    throw std::system_error{int(::GetLastError()), std::system_category(), "dmitigr::internal::os::resource_usage()"};
+  result.user_time = to_ns(user);
+  result.system_time = to_ns(kernel);
+  if (!::GetThreadTimes(::GetCurrentThread(), &creation, &exit, &kernel, &user))
+    throw std::system_error{int(::GetLastError()), std::system_category(), "dmitigr::internal::os::resource_usage()"};
+  result.thread_time = to_ns(kernel) + to_ns(user);
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage))
+    throw std::system_error{errno, std::system_category(), "dmitigr::internal::os::resource_usage()"};
+  const auto to_ns = [](const timeval& tv)
+  {
+    return std::chrono::nanoseconds{std::int64_t(tv.tv_sec) * 1000000000 + std::int64_t(tv.tv_usec) * 1000};
+  };
+  result.user_time = to_ns(usage.ru_utime);
+  result.system_time = to_ns(usage.ru_stime);
+  result.major_faults = usage.ru_majflt;
+  result.minor_faults = usage.ru_minflt;
+  result.voluntary_context_switches = usage.ru_nvcsw;
+  result.involuntary_context_switches = usage.ru_nivcsw;
+#ifdef __APPLE__
+  result.peak_resident_size = usage.ru_maxrss; // bytes
 #else
-  const auto result = ::lseek(fd, offset, int(whence));
+  result.peak_resident_size = std::int64_t(usage.ru_maxrss) * 1024; // kilobytes
 #endif
 
-  if (result < 0) {
-    const int err = errno;
-    throw std::system_error{err, std::system_category(), "dmitigr::http::internal::io::seek()"};
-  } else
-    return std::size_t(result);
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+    throw std::system_error{errno, std::system_category(), "dmitigr::internal::os::resource_usage()"};
+  result.thread_time = std::chrono::nanoseconds{std::int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec};
+
+#ifdef __linux__
+  char buffer[4096];
+  if (const auto status = read_proc_file__("/proc/self/status", buffer, sizeof(buffer)); !status.empty()) {
+    result.resident_size = proc_field__(status, "VmRSS") * 1024;
+    if (const auto hwm = proc_field__(status, "VmHWM"))
+      result.peak_resident_size = hwm * 1024;
+  }
+  if (const auto io = read_proc_file__("/proc/self/io", buffer, sizeof(buffer)); !io.empty()) {
+    result.read_chars = proc_field__(io, "rchar");
+    result.written_chars = proc_field__(io, "wchar");
+    result.read_bytes = proc_field__(io, "read_bytes");
+    result.written_bytes = proc_field__(io, "write_bytes");
+  }
+#endif
+#endif
+  return result;
 }
 
-DMITIGR_INTERNAL_INLINE std::size_t read(const int fd, void* const buffer, const unsigned int count)
+// -----------------------------------------------------------------------------
+// Memory pages
+
+namespace {
+
+/**
+ * @internal
+ *
+ * @returns The `size` rounded up to the multiple of the `alignment`.
+ */
+inline std::size_t round_up__(const std::size_t size, const std::size_t alignment) noexcept
 {
-  DMITIGR_INTERNAL_ASSERT(buffer);
+  return (size + alignment - 1) / alignment * alignment;
+}
 
+#ifdef __linux__
+/**
+ * @internal
+ *
+ * @returns `true` if transparent huge pages can be used with `madvise()`.
+ */
+inline bool is_transparent_huge_pages_enabled__() noexcept
+{
+  static const bool result = []
+  {
+    std::ifstream stream{"/sys/kernel/mm/transparent_hugepage/enabled"};
+    std::string line;
+    return std::getline(stream, line) && line.find("[never]") == std::string::npos;
+  }();
+  return result;
+}
+#endif
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE std::size_t page_size() noexcept
+{
+  static const std::size_t result = []
+  {
 #ifdef _WIN32
-  const auto result = ::_read(fd, buffer, count);
+    SYSTEM_INFO info;
+    ::GetSystemInfo(&info);
+    return static_cast<std::size_t>(info.dwPageSize);
 #else
-  const auto result = ::read(fd, buffer, count);
+    const auto result = sysconf(_SC_PAGESIZE);
+    return result > 0 ? static_cast<std::size_t>(result) : std::size_t{4096};
 #endif
+  }();
+  return result;
+}
 
-  if (result < 0) {
-    const int err = errno;
-    throw std::system_error{err, std::system_category(), "dmitigr::http::internal::io::read()"};
-  } else
-    return std::size_t(result);
+DMITIGR_INTERNAL_INLINE std::size_t huge_page_size() noexcept
+{
+  static const std::size_t result = []
+  {
+    std::size_t result = std::size_t{2} * 1024 * 1024;
+#ifdef __linux__
+    std::ifstream stream{"/proc/meminfo"};
+    for (std::string line; std::getline(stream, line);) {
+      if (!line.compare(0, 13, "Hugepagesize:")) {
+        if (const auto kb = std::strtoull(line.c_str() + 13, nullptr, 10))
+          result = static_cast<std::size_t>(kb) * 1024;
+        break;
+      }
+    }
+#endif
+    return result;
+  }();
+  return result;
 }
 
+DMITIGR_INTERNAL_INLINE void* map_pages(const std::size_t size,
+  const Page_kind preferred, Page_kind* const obtained)
+{
+  DMITIGR_INTERNAL_ASSERT(size > 0);
+  Page_kind dummy;
+  Page_kind& kind = obtained ? *obtained : dummy;
+#ifdef _WIN32
+  (void)preferred;
+  void* const result = ::VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  if (!result)
+    throw std::bad_alloc{};
+  kind = Page_kind::regular;
+  return result;
+#else
+  const std::size_t length = round_up__(size, huge_page_size());
+#ifdef __linux__
+  if (preferred == Page_kind::huge) {
+    void* const result = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (result != MAP_FAILED) {
+      kind = Page_kind::huge;
+      return result;
+    }
+  }
+
+  if (preferred != Page_kind::regular && is_transparent_huge_pages_enabled__()) {
+    // Over-map to trim the region to the huge page boundaries.
+    const std::size_t alignment = huge_page_size();
+    void* const raw = ::mmap(nullptr, length + alignment, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw != MAP_FAILED) {
+      const auto raw_addr = reinterpret_cast<std::uintptr_t>(raw);
+      const auto addr = round_up__(raw_addr, alignment);
+      if (const auto head = addr - raw_addr)
+        ::munmap(raw, head);
+      if (const auto tail = alignment - (addr - raw_addr))
+        ::munmap(reinterpret_cast<void*>(addr + length), tail);
+      void* const result = reinterpret_cast<void*>(addr);
+      kind = ::madvise(result, length, MADV_HUGEPAGE) ?
+        Page_kind::regular : Page_kind::transparent_huge;
+      return result;
+    }
+  }
+#else
+  (void)preferred;
+#endif
+
+  void* const result = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (result == MAP_FAILED)
+    throw std::bad_alloc{};
+  kind = Page_kind::regular;
+  return result;
+#endif
+}
+
+DMITIGR_INTERNAL_INLINE void unmap_pages(void* const data, const std::size_t size) noexcept
+{
+  if (!data)
+    return;
+#ifdef _WIN32
+  (void)size;
+  ::VirtualFree(data, 0, MEM_RELEASE);
+#else
+  ::munmap(data, round_up__(size, huge_page_size()));
+#endif
+}
+
+// -----------------------------------------------------------------------------
+
+namespace io {
+
+namespace {
+
+[[noreturn]] inline void throw_io_error__(const char* const fn)
+{
+  const int err = errno;
+  throw std::system_error{err, std::system_category(), std::string{"dmitigr::internal::os::io::"}.append(fn)};
+}
+
+/**
+ * @brief Calls `f(done)` until `count` bytes are transferred, `f()` returns 0,
+ * or the error (other than the interrupt) occurred.
+ *
+ * @returns The number of bytes transferred.
+ */
+template<typename F>
+std::size_t transfer_fully__(const std::size_t count, const char* const fn, F&& f)
+{
+  std::size_t result{};
+  while (result < count) {
+    const auto n = f(result);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      throw_io_error__(fn);
+    } else if (n == 0)
+      break;
+    result += static_cast<std::size_t>(n);
+  }
+  return result;
+}
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE std::uint64_t seek(const int fd, const std::int64_t offset, const Origin whence)
+{
+#ifdef _WIN32
+  const auto result = ::_lseeki64(fd, offset, int(whence));
+#else
+  const auto result = ::lseek(fd, static_cast<off_t>(offset), int(whence));
+#endif
+
+  if (result < 0)
+    throw_io_error__("seek()");
+  else
+    return std::uint64_t(result);
+}
+
+DMITIGR_INTERNAL_INLINE std::size_t read(const int fd, void* const buffer, const unsigned int count)
+{
+  DMITIGR_INTERNAL_ASSERT(buffer);
+
+#ifdef _WIN32
+  const auto result = ::_read(fd, buffer, count);
+#else
+  const auto result = ::read(fd, buffer, count);
+#endif
+
+  if (result < 0)
+    throw_io_error__("read()");
+  else
+    return std::size_t(result);
+}
+
+DMITIGR_INTERNAL_INLINE std::size_t write(const int fd, const void* const buffer, const unsigned int count)
+{
+  DMITIGR_INTERNAL_ASSERT(buffer);
+
+#ifdef _WIN32
+  const auto result = ::_write(fd, buffer, count);
+#else
+  const auto result = ::write(fd, buffer, count);
+#endif
+
+  if (result < 0)
+    throw_io_error__("write()");
+  else
+    return std::size_t(result);
+}
+
+DMITIGR_INTERNAL_INLINE std::size_t read_fully(const int fd, void* const buffer, const std::size_t count)
+{
+  DMITIGR_INTERNAL_ASSERT(buffer);
+  auto* const bytes = static_cast<char*>(buffer);
+  return transfer_fully__(count, "read_fully()", [&](const std::size_t done)
+  {
+#ifdef _WIN32
+    return ::_read(fd, bytes + done, static_cast<unsigned int>(std::min<std::size_t>(count - done, INT_MAX)));
+#else
+    return ::read(fd, bytes + done, count - done);
+#endif
+  });
+}
+
+DMITIGR_INTERNAL_INLINE void write_fully(const int fd, const void* const buffer, const std::size_t count)
+{
+  DMITIGR_INTERNAL_ASSERT(buffer);
+  const auto* const bytes = static_cast<const char*>(buffer);
+  const auto written = transfer_fully__(count, "write_fully()", [&](const std::size_t done)
+  {
+#ifdef _WIN32
+    return ::_write(fd, bytes + done, static_cast<unsigned int>(std::min<std::size_t>(count - done, INT_MAX)));
+#else
+    return ::write(fd, bytes + done, count - done);
+#endif
+  });
+  if (written < count) {
+    errno = EIO;
+    throw_io_error__("write_fully()");
+  }
+}
+
+#ifndef _WIN32
+
+DMITIGR_INTERNAL_INLINE std::size_t pread(const int fd, void* const buffer, const std::size_t count, const std::uint64_t offset)
+{
+  DMITIGR_INTERNAL_ASSERT(buffer);
+  const auto result = ::pread(fd, buffer, count, static_cast<off_t>(offset));
+  if (result < 0)
+    throw_io_error__("pread()");
+  else
+    return std::size_t(result);
+}
+
+DMITIGR_INTERNAL_INLINE std::size_t pwrite(const int fd, const void* const buffer, const std::size_t count, const std::uint64_t offset)
+{
+  DMITIGR_INTERNAL_ASSERT(buffer);
+  const auto result = ::pwrite(fd, buffer, count, static_cast<off_t>(offset));
+  if (result < 0)
+    throw_io_error__("pwrite()");
+  else
+    return std::size_t(result);
+}
+
+DMITIGR_INTERNAL_INLINE std::size_t pread_fully(const int fd, void* const buffer, const std::size_t count, const std::uint64_t offset)
+{
+  DMITIGR_INTERNAL_ASSERT(buffer);
+  auto* const bytes = static_cast<char*>(buffer);
+  return transfer_fully__(count, "pread_fully()", [&](const std::size_t done)
+  {
+    return ::pread(fd, bytes + done, count - done, static_cast<off_t>(offset + done));
+  });
+}
+
+DMITIGR_INTERNAL_INLINE void pwrite_fully(const int fd, const void* const buffer, const std::size_t count, const std::uint64_t offset)
+{
+  DMITIGR_INTERNAL_ASSERT(buffer);
+  const auto* const bytes = static_cast<const char*>(buffer);
+  const auto written = transfer_fully__(count, "pwrite_fully()", [&](const std::size_t done)
+  {
+    return ::pwrite(fd, bytes + done, count - done, static_cast<off_t>(offset + done));
+  });
+  if (written < count) {
+    errno = EIO;
+    throw_io_error__("pwrite_fully()");
+  }
+}
+
+DMITIGR_INTERNAL_INLINE std::size_t readv(const int fd, const ::iovec* const iov, const int iovcnt)
+{
+  DMITIGR_INTERNAL_ASSERT(iov || !iovcnt);
+  const auto result = ::readv(fd, iov, iovcnt);
+  if (result < 0)
+    throw_io_error__("readv()");
+  else
+    return std::size_t(result);
+}
+
+DMITIGR_INTERNAL_INLINE std::size_t writev(const int fd, const ::iovec* const iov, const int iovcnt)
+{
+  DMITIGR_INTERNAL_ASSERT(iov || !iovcnt);
+  const auto result = ::writev(fd, iov, iovcnt);
+  if (result < 0)
+    throw_io_error__("writev()");
+  else
+    return std::size_t(result);
+}
+
+DMITIGR_INTERNAL_INLINE void writev_fully(const int fd, ::iovec* iov, int iovcnt)
+{
+  DMITIGR_INTERNAL_ASSERT(iov || !iovcnt);
+  while (iovcnt > 0) {
+    const auto result = ::writev(fd, iov, iovcnt);
+    if (result < 0) {
+      if (errno == EINTR)
+        continue;
+      throw_io_error__("writev_fully()");
+    }
+
+    // Skip the buffers which are written completely and adjust the partially written one.
+    auto written = static_cast<std::size_t>(result);
+    for (; iovcnt > 0 && written >= iov->iov_len; ++iov, --iovcnt)
+      written -= iov->iov_len;
+    if (iovcnt > 0) {
+      iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+      iov->iov_len -= written;
+    }
+  }
+}
+
+namespace {
+
+#ifdef __linux__
+
+/** @returns `true` if the `err` means that the method of transfer is not applicable. */
+inline bool is_transfer_unsupported__(const int err) noexcept
+{
+  return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP || err == ENOTSUP;
+}
+
+/** The maximum number of bytes that Linux transfers per call. */
+constexpr std::uint64_t max_transfer_size__{0x7ffff000};
+
+/**
+ * @brief Transfers the data by copy_file_range().
+ *
+ * @returns `false` if the method is not applicable.
+ */
+inline bool copy_file_range_transfer__(const int in_fd, const int out_fd, std::uint64_t& offset,
+  std::uint64_t& done, const std::uint64_t count)
+{
+#ifdef __NR_copy_file_range
+  while (done < count) {
+    loff_t off = static_cast<loff_t>(offset);
+    const auto n = ::syscall(__NR_copy_file_range, in_fd, &off, out_fd, nullptr,
+      std::min(count - done, max_transfer_size__), 0U);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      // EBADF is returned when `out_fd` is opened with O_APPEND.
+      else if (is_transfer_unsupported__(errno) || errno == EBADF)
+        return false;
+      throw_io_error__("transfer()");
+    } else if (n == 0)
+      return done > 0; // some filesystems (like procfs) report 0 instead of error
+    offset += static_cast<std::uint64_t>(n);
+    done += static_cast<std::uint64_t>(n);
+  }
+  return true;
+#else
+  (void)in_fd; (void)out_fd; (void)offset; (void)done; (void)count;
+  return false;
+#endif
+}
+
+/**
+ * @brief Transfers the data by sendfile().
+ *
+ * @returns `false` if the method is not applicable.
+ */
+inline bool sendfile_transfer__(const int in_fd, const int out_fd, std::uint64_t& offset,
+  std::uint64_t& done, const std::uint64_t count)
+{
+  while (done < count) {
+    off_t off = static_cast<off_t>(offset);
+    const auto n = ::sendfile(out_fd, in_fd, &off, std::min(count - done, max_transfer_size__));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      else if (is_transfer_unsupported__(errno))
+        return false;
+      throw_io_error__("transfer()");
+    } else if (n == 0)
+      break;
+    offset += static_cast<std::uint64_t>(n);
+    done += static_cast<std::uint64_t>(n);
+  }
+  return true;
+}
+
+/**
+ * @brief Transfers the data by splice() through the intermediate pipe.
+ *
+ * @returns `false` if the method is not applicable.
+ */
+inline bool splice_transfer__(const int in_fd, const int out_fd, std::uint64_t& offset,
+  std::uint64_t& done, const std::uint64_t count)
+{
+  int pipe_fds[2];
+  if (::pipe2(pipe_fds, O_CLOEXEC) != 0)
+    return false;
+  const std::unique_ptr<int, void(*)(int*)> pipe_guard{pipe_fds, [](int* const fds)
+  {
+    ::close(fds[0]);
+    ::close(fds[1]);
+  }};
+
+  constexpr std::size_t chunk_size{64 * 1024}; // the default capacity of a pipe
+  while (done < count) {
+    loff_t off = static_cast<loff_t>(offset);
+    const auto n = ::splice(in_fd, &off, pipe_fds[1], nullptr, std::min<std::uint64_t>(count - done, chunk_size), SPLICE_F_MOVE);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      else if (is_transfer_unsupported__(errno))
+        return false;
+      throw_io_error__("transfer()");
+    } else if (n == 0)
+      break;
+
+    // Drain the pipe. (The data in the pipe is already consumed from the input.)
+    auto in_pipe = static_cast<std::size_t>(n);
+    bool is_splice_out_supported{true};
+    while (in_pipe) {
+      ::ssize_t m;
+      if (is_splice_out_supported) {
+        m = ::splice(pipe_fds[0], nullptr, out_fd, nullptr, in_pipe, SPLICE_F_MOVE);
+        if (m < 0 && is_transfer_unsupported__(errno)) {
+          is_splice_out_supported = false;
+          continue;
+        }
+      } else {
+        char buffer[4096];
+        m = ::read(pipe_fds[0], buffer, std::min(in_pipe, sizeof(buffer)));
+        if (m > 0)
+          write_fully(out_fd, buffer, static_cast<std::size_t>(m));
+      }
+      if (m < 0) {
+        if (errno == EINTR)
+          continue;
+        throw_io_error__("transfer()");
+      }
+      in_pipe -= static_cast<std::size_t>(m);
+    }
+    offset += static_cast<std::uint64_t>(n);
+    done += static_cast<std::uint64_t>(n);
+    if (!is_splice_out_supported)
+      return done == count; // let the buffered loop transfer the rest
+  }
+  return true;
+}
+
+#endif  // __linux__
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE std::uint64_t transfer(const int in_fd, const int out_fd, std::uint64_t offset, const std::uint64_t count)
+{
+  std::uint64_t result{};
+
+#ifdef __linux__
+  if (copy_file_range_transfer__(in_fd, out_fd, offset, result, count) ||
+    sendfile_transfer__(in_fd, out_fd, offset, result, count) ||
+    splice_transfer__(in_fd, out_fd, offset, result, count))
+    return result;
+#endif
+
+  constexpr std::size_t buffer_size{128 * 1024};
+  const std::unique_ptr<char[]> buffer{new char[buffer_size]};
+  while (result < count) {
+    const auto n = pread_fully(in_fd, buffer.get(), std::min<std::uint64_t>(count - result, buffer_size), offset);
+    if (!n)
+      break;
+    write_fully(out_fd, buffer.get(), n);
+    offset += n;
+    result += n;
+  }
+  return result;
+}
+
+// -----------------------------------------------------------------------------
+
+DMITIGR_INTERNAL_INLINE std::optional<Extent> next_data_extent(const int fd, const std::uint64_t offset)
+{
+  std::uint64_t begin, end;
+  try {
+    begin = seek(fd, static_cast<std::int64_t>(offset), seek_data);
+    end = seek(fd, static_cast<std::int64_t>(begin), seek_hole);
+  } catch (const std::system_error& e) {
+    if (e.code().value() == ENXIO)
+      return std::nullopt; // no more data
+    else if (e.code().value() != EINVAL)
+      throw;
+
+    // The filesystem doesn't support seek_data/seek_hole.
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+      throw_io_error__("next_data_extent()");
+    begin = offset;
+    end = static_cast<std::uint64_t>(st.st_size);
+  }
+  return begin < end ? std::make_optional(Extent{begin, end - begin}) : std::nullopt;
+}
+
+DMITIGR_INTERNAL_INLINE std::vector<Extent> data_extents(const int fd)
+{
+  std::vector<Extent> result;
+  for (auto e = next_data_extent(fd, 0); e; e = next_data_extent(fd, e->offset + e->size))
+    result.push_back(*e);
+  return result;
+}
+
+DMITIGR_INTERNAL_INLINE void read_data(const int fd, const Read_data_callback& callback, const std::size_t block_size)
+{
+  DMITIGR_INTERNAL_ASSERT(callback && block_size);
+  const std::unique_ptr<char[]> block{new char[block_size]};
+  for (auto e = next_data_extent(fd, 0); e; e = next_data_extent(fd, e->offset + e->size)) {
+    for (std::uint64_t done{}; done < e->size;) {
+      const auto n = pread_fully(fd, block.get(), std::min<std::uint64_t>(e->size - done, block_size), e->offset + done);
+      if (!n)
+        return; // the file is truncated meanwhile
+      callback(e->offset + done, block.get(), n);
+      done += n;
+    }
+  }
+}
+
+DMITIGR_INTERNAL_INLINE std::uint64_t copy_sparse(const int in_fd, const int out_fd)
+{
+  std::uint64_t result{};
+  for (auto e = next_data_extent(in_fd, 0); e; e = next_data_extent(in_fd, e->offset + e->size)) {
+    seek(out_fd, static_cast<std::int64_t>(e->offset), seek_set);
+    result += transfer(in_fd, out_fd, e->offset, e->size);
+  }
+
+  // Recreate the trailing hole (if any).
+  struct stat st;
+  if (::fstat(in_fd, &st) != 0 || ::ftruncate(out_fd, st.st_size) != 0)
+    throw_io_error__("copy_sparse()");
+  return result;
+}
+
+// -----------------------------------------------------------------------------
+
+class Async_io::Engine {
+public:
+  virtual ~Engine() = default;
+
+  virtual bool is_io_uring() const noexcept = 0;
+
+  virtual void register_buffers(const ::iovec* iov, unsigned count) = 0;
+
+  virtual void register_files(const int* fds, unsigned count) = 0;
+
+  virtual void prepare(const Async_request& request) = 0;
+
+  virtual std::size_t submit() = 0;
+
+  /**
+   * @brief Appends the available completions to `completions`, waiting for
+   * at least `min_count` of them.
+   *
+   * @returns The number of completions appended.
+   */
+  virtual std::size_t wait(std::vector<Async_completion>& completions, std::size_t min_count) = 0;
+};
+
+namespace {
+
+/**
+ * @brief The engine which performs the requests on a pool of threads.
+ */
+class Thread_engine final : public Async_io::Engine {
+public:
+  explicit Thread_engine(std::size_t thread_count)
+  {
+    if (!thread_count)
+      thread_count = std::clamp<std::size_t>(std::thread::hardware_concurrency(), 4, 32);
+    threads_.reserve(thread_count);
+    try {
+      for (std::size_t i = 0; i < thread_count; ++i)
+        threads_.emplace_back([this]{ work(); });
+    } catch (...) {
+      stop();
+      throw;
+    }
+  }
+
+  ~Thread_engine() override
+  {
+    stop();
+  }
+
+  bool is_io_uring() const noexcept override
+  {
+    return false;
+  }
+
+  void register_buffers(const ::iovec* const iov, const unsigned count) override
+  {
+    buffers_.assign(iov, iov + count);
+  }
+
+  void register_files(const int* const fds, const unsigned count) override
+  {
+    files_.assign(fds, fds + count);
+  }
+
+  void prepare(const Async_request& request) override
+  {
+    if (request.buffer_index >= 0) {
+      const auto index = static_cast<std::size_t>(request.buffer_index);
+      if (index >= buffers_.size())
+        throw std::out_of_range{"dmitigr::internal::os::io::Async_io::prepare(): invalid buffer index"};
+    }
+    if (request.is_registered_file && static_cast<std::size_t>(request.fd) >= files_.size())
+      throw std::out_of_range{"dmitigr::internal::os::io::Async_io::prepare(): invalid file index"};
+    prepared_.push_back(request);
+  }
+
+  std::size_t submit() override
+  {
+    const auto result = prepared_.size();
+    if (result) {
+      {
+        const std::lock_guard lg{mutex_};
+        requests_.insert(end(requests_), cbegin(prepared_), cend(prepared_));
+      }
+      prepared_.clear();
+      requests_cv_.notify_all();
+    }
+    return result;
+  }
+
+  std::size_t wait(std::vector<Async_completion>& completions, const std::size_t min_count) override
+  {
+    std::unique_lock lk{mutex_};
+    completions_cv_.wait(lk, [&]{ return completions_.size() >= min_count; });
+    const auto result = completions_.size();
+    completions.insert(end(completions), cbegin(completions_), cend(completions_));
+    completions_.clear();
+    return result;
+  }
+
+private:
+  std::vector<std::thread> threads_;
+  std::vector<::iovec> buffers_;
+  std::vector<int> files_;
+  std::vector<Async_request> prepared_;
+  std::mutex mutex_;
+  std::condition_variable requests_cv_;
+  std::condition_variable completions_cv_;
+  std::deque<Async_request> requests_;
+  std::vector<Async_completion> completions_;
+  bool is_stopped_{};
+
+  void work()
+  {
+    while (true) {
+      Async_request request;
+      {
+        std::unique_lock lk{mutex_};
+        requests_cv_.wait(lk, [this]{ return is_stopped_ || !requests_.empty(); });
+        if (requests_.empty())
+          return;
+        request = requests_.front();
+        requests_.pop_front();
+      }
+
+      const int fd = request.is_registered_file ? files_[static_cast<std::size_t>(request.fd)] : request.fd;
+      ::ssize_t result;
+      do {
+        if (request.kind == Async_request::Kind::read)
+          result = ::pread(fd, request.buffer, request.count, static_cast<off_t>(request.offset));
+        else
+          result = ::pwrite(fd, request.buffer, request.count, static_cast<off_t>(request.offset));
+      } while (result < 0 && errno == EINTR);
+      const Async_completion completion{request.user_data, result < 0 ? -std::int64_t{errno} : std::int64_t{result}};
+
+      {
+        const std::lock_guard lg{mutex_};
+        completions_.push_back(completion);
+      }
+      completions_cv_.notify_one();
+    }
+  }
+
+  void stop() noexcept
+  {
+    {
+      const std::lock_guard lg{mutex_};
+      is_stopped_ = true;
+    }
+    requests_cv_.notify_all();
+    for (auto& thread : threads_)
+      thread.join();
+  }
+};
+
+#ifdef __linux__
+
+/**
+ * @brief The engine which performs the requests by using the io_uring interface.
+ */
+class Uring_engine final : public Async_io::Engine {
+public:
+  /**
+   * @returns The engine, or `nullptr` if io_uring or the required operations
+   * are not supported by the kernel.
+   */
+  static std::unique_ptr<Uring_engine> make(const unsigned queue_depth)
+  {
+    std::unique_ptr<Uring_engine> result{new Uring_engine};
+    ::io_uring_params params{};
+    result->fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, queue_depth, &params));
+    if (result->fd_ < 0 || !result->is_supported() || !result->map(params))
+      return nullptr;
+    return result;
+  }
+
+  ~Uring_engine() override
+  {
+    if (sqes_ != MAP_FAILED)
+      ::munmap(sqes_, sqes_size_);
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+      ::munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != MAP_FAILED)
+      ::munmap(sq_ring_, sq_ring_size_);
+    if (fd_ >= 0)
+      ::close(fd_);
+  }
+
+  bool is_io_uring() const noexcept override
+  {
+    return true;
+  }
+
+  void register_buffers(const ::iovec* const iov, const unsigned count) override
+  {
+    if (has_buffers_) {
+      register__(IORING_UNREGISTER_BUFFERS, nullptr, 0);
+      has_buffers_ = false;
+    }
+    if (count) {
+      register__(IORING_REGISTER_BUFFERS, iov, count);
+      has_buffers_ = true;
+    }
+  }
+
+  void register_files(const int* const fds, const unsigned count) override
+  {
+    if (has_files_) {
+      register__(IORING_UNREGISTER_FILES, nullptr, 0);
+      has_files_ = false;
+    }
+    if (count) {
+      register__(IORING_REGISTER_FILES, fds, count);
+      has_files_ = true;
+    }
+  }
+
+  void prepare(const Async_request& request) override
+  {
+    const auto tail = *sq_tail_;
+    DMITIGR_INTERNAL_ASSERT(tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) < sq_entries_);
+    const auto index = tail & *sq_mask_;
+    auto& sqe = sqes_[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    const bool is_read = request.kind == Async_request::Kind::read;
+    if (request.buffer_index >= 0) {
+      sqe.opcode = is_read ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+      sqe.buf_index = static_cast<decltype(sqe.buf_index)>(request.buffer_index);
+    } else
+      sqe.opcode = is_read ? IORING_OP_READ : IORING_OP_WRITE;
+    if (request.is_registered_file)
+      sqe.flags = IOSQE_FIXED_FILE;
+    sqe.fd = request.fd;
+    sqe.off = request.offset;
+    sqe.addr = reinterpret_cast<std::uintptr_t>(request.buffer);
+    // Linux transfers at most 0x7ffff000 bytes per request anyway.
+    sqe.len = static_cast<std::uint32_t>(std::min<std::size_t>(request.count, 0x7ffff000));
+    sqe.user_data = request.user_data;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++prepared_count_;
+  }
+
+  std::size_t submit() override
+  {
+    const auto result = prepared_count_;
+    while (prepared_count_) {
+      const auto submitted = enter(static_cast<unsigned>(prepared_count_), 0, 0);
+      if (!submitted) {
+        // The kernel accepts no requests (e.g. the completion queue is full).
+        errno = EAGAIN;
+        throw_io_error__("Async_io::submit");
+      }
+      prepared_count_ -= submitted;
+    }
+    return result;
+  }
+
+  std::size_t wait(std::vector<Async_completion>& completions, const std::size_t min_count) override
+  {
+    std::size_t result{};
+    while (true) {
+      auto head = *cq_head_;
+      const auto tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      for (; head != tail; ++head, ++result) {
+        const auto& cqe = cqes_[head & *cq_mask_];
+        completions.push_back({cqe.user_data, cqe.res});
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+      if (result >= min_count)
+        return result;
+      enter(0, static_cast<unsigned>(min_count - result), IORING_ENTER_GETEVENTS);
+    }
+  }
+
+private:
+  int fd_{-1};
+  void* sq_ring_{MAP_FAILED};
+  void* cq_ring_{MAP_FAILED};
+  std::size_t sq_ring_size_{};
+  std::size_t cq_ring_size_{};
+  ::io_uring_sqe* sqes_{static_cast<::io_uring_sqe*>(MAP_FAILED)};
+  std::size_t sqes_size_{};
+  unsigned* sq_head_{};
+  unsigned* sq_tail_{};
+  unsigned* sq_mask_{};
+  unsigned* sq_array_{};
+  unsigned sq_entries_{};
+  unsigned* cq_head_{};
+  unsigned* cq_tail_{};
+  unsigned* cq_mask_{};
+  ::io_uring_cqe* cqes_{};
+  std::size_t prepared_count_{};
+  bool has_buffers_{};
+  bool has_files_{};
+
+  Uring_engine() = default;
+
+  /** @returns `true` if the required operations are supported. */
+  bool is_supported() const
+  {
+    constexpr unsigned op_count{256};
+    const std::size_t size = sizeof(::io_uring_probe) + op_count * sizeof(::io_uring_probe_op);
+    const std::unique_ptr<void, void(*)(void*)> buffer{std::calloc(1, size), &std::free};
+    if (!buffer)
+      return false;
+    auto* const probe = static_cast<::io_uring_probe*>(buffer.get());
+    if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, op_count) < 0)
+      return false; // the probing is not supported (Linux < 5.6)
+    for (const unsigned op : {IORING_OP_READ, IORING_OP_WRITE, IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED}) {
+      if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+        return false;
+    }
+    return true;
+  }
+
+  /** @returns `true` on success. */
+  bool map(const ::io_uring_params& params)
+  {
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(::io_uring_cqe);
+    const bool is_single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (is_single_mmap)
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+    constexpr int prot = PROT_READ | PROT_WRITE;
+    constexpr int flags = MAP_SHARED | MAP_POPULATE;
+    sq_ring_ = ::mmap(nullptr, sq_ring_size_, prot, flags, fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED)
+      return false;
+    cq_ring_ = is_single_mmap ? sq_ring_ : ::mmap(nullptr, cq_ring_size_, prot, flags, fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED)
+      return false;
+    sqes_size_ = params.sq_entries * sizeof(::io_uring_sqe);
+    sqes_ = static_cast<::io_uring_sqe*>(::mmap(nullptr, sqes_size_, prot, flags, fd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED)
+      return false;
+
+    auto* const sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_entries_ = params.sq_entries;
+    auto* const cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<::io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  /** @returns The number of requests submitted. */
+  std::size_t enter(const unsigned to_submit, const unsigned min_complete, const unsigned flags)
+  {
+    while (true) {
+      const auto result = ::syscall(__NR_io_uring_enter, fd_, to_submit, min_complete, flags, nullptr, 0);
+      if (result >= 0)
+        return static_cast<std::size_t>(result);
+      else if (errno != EINTR)
+        throw_io_error__("Async_io");
+    }
+  }
+
+  void register__(const unsigned opcode, const void* const arg, const unsigned count)
+  {
+    if (::syscall(__NR_io_uring_register, fd_, opcode, arg, count) < 0)
+      throw_io_error__("Async_io::register");
+  }
+};
+
+#endif  // __linux__
+
+} // namespace
+
+DMITIGR_INTERNAL_INLINE Async_io::Async_io()
+  : Async_io{Options{}}
+{}
+
+DMITIGR_INTERNAL_INLINE Async_io::Async_io(const Options& options)
+  : queue_depth_{std::max(options.queue_depth, 1U)}
+{
+#ifdef __linux__
+  if (!options.is_fallback_forced)
+    engine_ = Uring_engine::make(queue_depth_);
+#endif
+  if (!engine_)
+    engine_ = std::make_unique<Thread_engine>(options.fallback_thread_count);
+}
+
+DMITIGR_INTERNAL_INLINE Async_io::~Async_io()
+{
+  // The kernel or the threads may still access the buffers of the requests in flight.
+  try {
+    std::vector<Async_completion> completions;
+    reap(completions, in_flight_count_);
+  } catch (...) {}
+}
+
+DMITIGR_INTERNAL_INLINE bool Async_io::is_io_uring() const noexcept
+{
+  return engine_->is_io_uring();
+}
+
+DMITIGR_INTERNAL_INLINE unsigned Async_io::queue_depth() const noexcept
+{
+  return queue_depth_;
+}
+
+DMITIGR_INTERNAL_INLINE void Async_io::register_buffers(const ::iovec* const iov, const unsigned count)
+{
+  DMITIGR_INTERNAL_ASSERT(!in_flight_count_);
+  DMITIGR_INTERNAL_ASSERT(iov || !count);
+  engine_->register_buffers(iov, count);
+}
+
+DMITIGR_INTERNAL_INLINE void Async_io::register_files(const int* const fds, const unsigned count)
+{
+  DMITIGR_INTERNAL_ASSERT(!in_flight_count_);
+  DMITIGR_INTERNAL_ASSERT(fds || !count);
+  engine_->register_files(fds, count);
+}
+
+DMITIGR_INTERNAL_INLINE void Async_io::prepare(const Async_request& request)
+{
+  DMITIGR_INTERNAL_ASSERT(request.buffer || !request.count);
+  if (in_flight_count_ >= queue_depth_) {
+    submit();
+    in_flight_count_ -= engine_->wait(ready_, 1);
+  }
+  engine_->prepare(request);
+  ++in_flight_count_;
+}
+
+DMITIGR_INTERNAL_INLINE std::size_t Async_io::submit()
+{
+  return engine_->submit();
+}
+
+DMITIGR_INTERNAL_INLINE std::size_t Async_io::reap(std::vector<Async_completion>& completions, const std::size_t min_count)
+{
+  std::size_t result = ready_.size();
+  completions.insert(end(completions), cbegin(ready_), cend(ready_));
+  ready_.clear();
+  submit();
+  const auto count = engine_->wait(completions, std::min(min_count - std::min(min_count, result), in_flight_count_));
+  in_flight_count_ -= count;
+  return result + count;
+}
+
+DMITIGR_INTERNAL_INLINE std::size_t Async_io::pending_count() const noexcept
+{
+  return in_flight_count_ + ready_.size();
+}
+
+#endif  // _WIN32
+
 } // namespace io
 
 } // namespace dmitigr::internal::os
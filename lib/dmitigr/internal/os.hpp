@@ -7,9 +7,34 @@
 
 #include "dmitigr/internal/dll.hpp"
 
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <new>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define DMITIGR_INTERNAL_CLOCK_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
 
 namespace dmitigr::internal::os {
 
@@ -24,6 +49,8 @@ DMITIGR_INTERNAL_API std::string current_working_directory();
  * @internal
  *
  * @returns The string with the current username.
+ *
+ * @see Process_context::username().
  */
 DMITIGR_INTERNAL_API std::string current_username();
 
@@ -34,9 +61,705 @@ DMITIGR_INTERNAL_API std::string current_username();
  *
  * @remarks Cannot be used in applications that execute in the Windows Runtime, because
  * environment variables are not available to UWP applications.
+ *
+ * @see Process_context::environment_variable().
  */
 DMITIGR_INTERNAL_API std::optional<std::string> environment_variable(const std::string& name);
 
+// -----------------------------------------------------------------------------
+// Process context
+
+/**
+ * @internal
+ *
+ * @brief An immutable snapshot of the process context: the environment and
+ * the identity of the user.
+ *
+ * @details The snapshot is built on the first call of `current()` and can be
+ * rebuilt by `refresh()` (for example, after the environment modification).
+ * Both functions publish the snapshot under the lock, so it can be safely
+ * used from any thread. The snapshot is released when the last holder of it
+ * releases it.
+ *
+ * Readers on hot paths should use the Reader, which doesn't take locks unless
+ * the new snapshot has been published since its previous use.
+ */
+class Process_context final {
+public:
+  /**
+   * @brief Represents a reader of the current snapshot.
+   *
+   * @details The reader holds the snapshot it has seen last, and checks the
+   * generation of the snapshots (by the single atomic load) on each access.
+   * The reader is intended to be used by one thread.
+   */
+  class Reader final {
+  public:
+    /** The constructor. */
+    Reader()
+    {
+      get();
+    }
+
+    /** @returns The current snapshot. */
+    const Process_context& get()
+    {
+      const auto generation = Process_context::generation();
+      if (generation != generation_ || !snapshot_) {
+        snapshot_ = current();
+        generation_ = generation;
+      }
+      return *snapshot_;
+    }
+
+    /** @returns `get()`. */
+    const Process_context& operator*()
+    {
+      return get();
+    }
+
+    /** @returns `&get()`. */
+    const Process_context* operator->()
+    {
+      return &get();
+    }
+
+  private:
+    std::uint64_t generation_{};
+    std::shared_ptr<const Process_context> snapshot_;
+  };
+
+  /** @returns The current snapshot. Builds it on the first call. */
+  DMITIGR_INTERNAL_API static std::shared_ptr<const Process_context> current();
+
+  /**
+   * @brief Builds the new snapshot and publishes it as current.
+   *
+   * @returns The new snapshot.
+   */
+  DMITIGR_INTERNAL_API static std::shared_ptr<const Process_context> refresh();
+
+  /** @returns The number of the snapshots published so far. */
+  DMITIGR_INTERNAL_API static std::uint64_t generation() noexcept;
+
+  /**
+   * @returns The value of the environment variable `name`, or std::nullopt if
+   * there is no match.
+   */
+  DMITIGR_INTERNAL_API std::optional<std::string_view> environment_variable(std::string_view name) const noexcept;
+
+  /** @returns The number of the environment variables. */
+  std::size_t environment_variable_count() const noexcept
+  {
+    return variables_.size();
+  }
+
+  /** @returns The effective user ID, or `-1` on Windows. */
+  long long user_id() const noexcept
+  {
+    return user_id_;
+  }
+
+  /** @returns The username, or empty string if it's unavailable. */
+  const std::string& username() const noexcept
+  {
+    return username_;
+  }
+
+  /** @returns The home directory of the user, or empty string if it's unavailable. */
+  const std::string& home_directory() const noexcept
+  {
+    return home_directory_;
+  }
+
+private:
+  std::string environment_; // "name=value\0" entries
+  std::unordered_map<std::string_view, std::string_view> variables_;
+  long long user_id_{-1};
+  std::string username_;
+  std::string home_directory_;
+
+  Process_context();
+};
+
+// -----------------------------------------------------------------------------
+// CPU topology
+
+/**
+ * @internal
+ *
+ * @brief Represents a logical CPU.
+ */
+struct Cpu final {
+  /** The identifier of the logical CPU. */
+  unsigned id{};
+
+  /** The identifier of the physical core, or `-1` if unknown. */
+  int core_id{-1};
+
+  /** The identifier of the physical package (socket), or `-1` if unknown. */
+  int package_id{-1};
+
+  /** The identifier of the NUMA node, or `-1` if unknown. */
+  int node_id{-1};
+
+  /** The identifiers of the logical CPUs of the same physical core (including this one). */
+  std::vector<unsigned> siblings;
+};
+
+/**
+ * @internal
+ *
+ * @brief Represents a CPU cache.
+ */
+struct Cpu_cache final {
+  /** The level of the cache. */
+  unsigned level{};
+
+  /** The type of the cache: "Data", "Instruction" or "Unified". */
+  std::string type;
+
+  /** The size of the cache in bytes. */
+  std::size_t size{};
+
+  /** The size of the cache line in bytes. */
+  std::size_t line_size{};
+
+  /** The identifiers of the logical CPUs that share the cache. */
+  std::vector<unsigned> cpus;
+};
+
+/**
+ * @internal
+ *
+ * @brief Represents a NUMA node.
+ */
+struct Numa_node final {
+  /** The identifier of the node. */
+  unsigned id{};
+
+  /** The identifiers of the logical CPUs of the node. */
+  std::vector<unsigned> cpus;
+};
+
+/**
+ * @internal
+ *
+ * @brief Represents the CPU topology of the system and the CPU limits of the
+ * current process.
+ */
+struct Cpu_topology final {
+  /** The online logical CPUs sorted by identifier. */
+  std::vector<Cpu> cpus;
+
+  /** The distinct caches. */
+  std::vector<Cpu_cache> caches;
+
+  /** The NUMA nodes sorted by identifier. */
+  std::vector<Numa_node> nodes;
+
+  /** The identifiers of the logical CPUs the current process is allowed to run on. */
+  std::vector<unsigned> affinity;
+
+  /** The CPU quota of the control group of the current process (in CPUs), or `std::nullopt` if unlimited. */
+  std::optional<double> cpu_quota;
+
+  /** @returns The number of logical CPUs. */
+  std::size_t logical_cpu_count() const noexcept
+  {
+    return cpus.size();
+  }
+
+  /** @returns The number of physical cores. */
+  DMITIGR_INTERNAL_API std::size_t physical_core_count() const;
+
+  /**
+   * @returns The number of CPUs the current process can actually use with
+   * respect to the affinity and the CPU quota.
+   */
+  DMITIGR_INTERNAL_API std::size_t available_cpu_count() const noexcept;
+
+  /**
+   * @returns The cache of the given `level` and `type` which is used by the
+   * logical CPU `cpu`, or `nullptr` if there is no such a cache.
+   */
+  DMITIGR_INTERNAL_API const Cpu_cache* cache(unsigned cpu, unsigned level, std::string_view type = "Data") const noexcept;
+};
+
+/**
+ * @internal
+ *
+ * @returns The CPU topology.
+ *
+ * @remarks On Linux, the topology is obtained from the `/sys/devices/system`
+ * and the cgroup filesystem. On other systems only the number of logical CPUs
+ * is known.
+ */
+DMITIGR_INTERNAL_API Cpu_topology cpu_topology();
+
+/**
+ * @internal
+ *
+ * @brief Restricts the current thread to run on the given logical CPUs.
+ *
+ * @par Requires
+ * `!cpus.empty()`.
+ */
+DMITIGR_INTERNAL_API void pin_current_thread(const std::vector<unsigned>& cpus);
+
+/**
+ * @internal
+ *
+ * @brief Restricts the current thread to run on the logical CPUs of the
+ * given NUMA `node`.
+ *
+ * @par Requires
+ * `node` is a valid node of the `topology`.
+ */
+DMITIGR_INTERNAL_API void pin_current_thread_to_node(const Cpu_topology& topology, unsigned node);
+
+// -----------------------------------------------------------------------------
+// Monotonic clock
+
+/**
+ * @internal
+ *
+ * @brief The calibration of the clock.
+ *
+ * @see clock_calibration(), Clock.
+ */
+struct Clock_calibration final {
+  /** `true` if the clock ticks are read from an invariant TSC. */
+  bool is_tsc{};
+
+  /** The ticks at the calibration point, which is the epoch of `Clock`. */
+  std::uint64_t base_ticks{};
+
+  /** The number of nanoseconds per tick in the 32.32 fixed-point format. */
+  std::uint64_t multiplier{1ULL << 32};
+
+  /** The (measured) number of ticks per second. */
+  double ticks_per_second{1e9};
+};
+
+/**
+ * @internal
+ *
+ * @returns The process-wide clock calibration, which is performed on the
+ * first call (it takes about 10 milliseconds if an invariant TSC is used).
+ *
+ * @remarks The TSC is used only on x86 processors which report the invariant
+ * TSC and only if the operating system doesn't consider the TSC as unreliable.
+ * Otherwise the ticks are the nanoseconds of `std::chrono::steady_clock`.
+ */
+DMITIGR_INTERNAL_API const Clock_calibration& clock_calibration() noexcept;
+
+/**
+ * @internal
+ *
+ * @brief A monotonic clock with a low overhead suitable for permanent
+ * instrumentation of hot paths.
+ *
+ * @details The clock satisfies the requirements of Clock (of the standard
+ * library), but its epoch is unspecified: the TSC rate is measured once, so
+ * the clock drifts away from `std::chrono::steady_clock` (a relative error of
+ * 1e-5 is tens of milliseconds per hour), and the time points of these clocks
+ * are not comparable. The clock is intended to measure intervals. The
+ * cheapest way to measure is to keep an instance, read the raw `ticks()` and
+ * convert the differences to nanoseconds by `elapsed_nanoseconds()` only when
+ * the result is reported.
+ */
+class Clock final {
+public:
+  /** The Clock requirement. */
+  using rep = std::int64_t;
+
+  /** The Clock requirement. */
+  using period = std::nano;
+
+  /** The Clock requirement. */
+  using duration = std::chrono::duration<rep, period>;
+
+  /** The Clock requirement. */
+  using time_point = std::chrono::time_point<Clock>;
+
+  /** The Clock requirement. */
+  static constexpr bool is_steady = true;
+
+  /** @returns The current time point. */
+  static time_point now() noexcept
+  {
+    static const Clock clock;
+    return time_point{duration{clock.nanoseconds(clock.ticks())}};
+  }
+
+  /** The constructor. Copies the clock_calibration(). */
+  Clock() noexcept
+    : calibration_{clock_calibration()}
+  {}
+
+  /** @returns `true` if the ticks are read from an invariant TSC. */
+  bool is_tsc() const noexcept
+  {
+    return calibration_.is_tsc;
+  }
+
+  /** @returns The calibration of this instance. */
+  const Clock_calibration& calibration() const noexcept
+  {
+    return calibration_;
+  }
+
+  /**
+   * @returns The current ticks.
+   *
+   * @remarks The TSC is read by `rdtsc` which is not serializing, so the
+   * reading may be reordered with neighbouring instructions by the processor.
+   *
+   * @see ticks_ordered().
+   */
+  std::uint64_t ticks() const noexcept
+  {
+#ifdef DMITIGR_INTERNAL_CLOCK_X86
+    if (calibration_.is_tsc)
+      return __rdtsc();
+#endif
+    return steady_ticks();
+  }
+
+  /**
+   * @returns The current ticks read after all the previous instructions have
+   * been executed (by `rdtscp`).
+   */
+  std::uint64_t ticks_ordered() const noexcept
+  {
+#ifdef DMITIGR_INTERNAL_CLOCK_X86
+    if (calibration_.is_tsc) {
+      unsigned aux;
+      return __rdtscp(&aux);
+    }
+#endif
+    return steady_ticks();
+  }
+
+  /**
+   * @returns The time point (in nanoseconds since the unspecified epoch) of
+   * `ticks`.
+   */
+  std::int64_t nanoseconds(const std::uint64_t ticks) const noexcept
+  {
+    return elapsed_nanoseconds(calibration_.base_ticks, ticks);
+  }
+
+  /** @returns The number of nanoseconds elapsed between `from` and `to`. */
+  std::int64_t elapsed_nanoseconds(const std::uint64_t from, const std::uint64_t to) const noexcept
+  {
+    if (!calibration_.is_tsc)
+      return static_cast<std::int64_t>(to - from);
+    else
+      return to >= from ? scale(to - from) : -scale(from - to);
+  }
+
+private:
+  Clock_calibration calibration_;
+
+  static std::uint64_t steady_ticks() noexcept
+  {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+  std::int64_t scale(const std::uint64_t ticks) const noexcept
+  {
+    // The multiplier is less than 2^32 (see clock_calibration()).
+    const std::uint64_t hi = ticks >> 32;
+    const std::uint64_t lo = ticks & 0xffffffff;
+    return static_cast<std::int64_t>(hi * calibration_.multiplier +
+      ((lo * calibration_.multiplier) >> 32));
+  }
+};
+
+// -----------------------------------------------------------------------------
+// Resource usage
+
+/**
+ * @internal
+ *
+ * @brief A snapshot of the resource usage of the current process.
+ *
+ * @details The fields are signed so that the difference of two snapshots,
+ * which measures a region of code, is well-defined. Unavailable fields are
+ * zero.
+ *
+ * @see resource_usage().
+ */
+struct Resource_usage final {
+  /** The resident set size in bytes. */
+  std::int64_t resident_size{};
+
+  /** The peak resident set size in bytes. */
+  std::int64_t peak_resident_size{};
+
+  /** The number of page faults which required I/O. */
+  std::int64_t major_faults{};
+
+  /** The number of page faults which were serviced without I/O. */
+  std::int64_t minor_faults{};
+
+  /** The number of voluntary context switches. */
+  std::int64_t voluntary_context_switches{};
+
+  /** The number of involuntary context switches. */
+  std::int64_t involuntary_context_switches{};
+
+  /** The number of bytes read by the read-like system calls. */
+  std::int64_t read_chars{};
+
+  /** The number of bytes written by the write-like system calls. */
+  std::int64_t written_chars{};
+
+  /** The number of bytes fetched from the storage layer. */
+  std::int64_t read_bytes{};
+
+  /** The number of bytes sent to the storage layer. */
+  std::int64_t written_bytes{};
+
+  /** The CPU time spent by the process in the user mode. */
+  std::chrono::nanoseconds user_time{};
+
+  /** The CPU time spent by the process in the kernel mode. */
+  std::chrono::nanoseconds system_time{};
+
+  /** The CPU time spent by the calling thread. */
+  std::chrono::nanoseconds thread_time{};
+
+  /** @returns The field-wise difference between this and `rhs`. */
+  DMITIGR_INTERNAL_API Resource_usage operator-(const Resource_usage& rhs) const noexcept;
+};
+
+/**
+ * @internal
+ *
+ * @returns The snapshot of the resource usage of the current process.
+ *
+ * @remarks On Linux, the `/proc/self/status` and `/proc/self/io` files are
+ * read once each into a stack buffer, so the function doesn't allocate.
+ * On other systems only the data available from `getrusage()` (or from the
+ * process and thread times on Windows) is provided.
+ */
+DMITIGR_INTERNAL_API Resource_usage resource_usage();
+
+// -----------------------------------------------------------------------------
+// Memory pages
+
+/**
+ * @internal
+ *
+ * @brief A kind of memory pages.
+ */
+enum class Page_kind {
+  /** Regular pages. */
+  regular,
+
+  /** Transparent huge pages (advised by `MADV_HUGEPAGE`). */
+  transparent_huge,
+
+  /** Huge pages from the reserved pool (`MAP_HUGETLB`). */
+  huge
+};
+
+/**
+ * @internal
+ *
+ * @returns The size of the regular memory page.
+ */
+DMITIGR_INTERNAL_API std::size_t page_size() noexcept;
+
+/**
+ * @internal
+ *
+ * @returns The size of the default huge memory page.
+ */
+DMITIGR_INTERNAL_API std::size_t huge_page_size() noexcept;
+
+/**
+ * @internal
+ *
+ * @brief Maps the anonymous memory region of `size` bytes.
+ *
+ * @details The pages of the `preferred` kind are tried first, then the pages of
+ * the lesser kinds: `huge`, `transparent_huge`, `regular`. The region is aligned
+ * to the `huge_page_size()` if the huge pages (of any kind) are obtained, or to
+ * the `page_size()` otherwise.
+ *
+ * @param obtained If not `nullptr`, receives the kind of pages actually obtained.
+ * The `transparent_huge` means that the region is suitably aligned and advised,
+ * but the kernel may still back (parts of) it with regular pages.
+ *
+ * @returns The pointer to the region, which must be released by `unmap_pages()`.
+ *
+ * @par Requires
+ * `size > 0`.
+ *
+ * @throws `std::bad_alloc` if even regular pages cannot be obtained.
+ */
+DMITIGR_INTERNAL_API void* map_pages(std::size_t size,
+  Page_kind preferred = Page_kind::huge, Page_kind* obtained = nullptr);
+
+/**
+ * @internal
+ *
+ * @brief Unmaps the region returned by `map_pages(size)`.
+ */
+DMITIGR_INTERNAL_API void unmap_pages(void* data, std::size_t size) noexcept;
+
+/**
+ * @internal
+ *
+ * @brief A memory region mapped by `map_pages()`.
+ */
+class Memory_region final {
+public:
+  /** Constructs the empty region. */
+  Memory_region() noexcept = default;
+
+  /** Maps the region. See `map_pages()`. */
+  explicit Memory_region(const std::size_t size, const Page_kind preferred = Page_kind::huge)
+  {
+    data_ = map_pages(size, preferred, &page_kind_);
+    size_ = size;
+  }
+
+  /** Unmaps the region. */
+  ~Memory_region()
+  {
+    if (data_)
+      unmap_pages(data_, size_);
+  }
+
+  /** Non copy-constructible. */
+  Memory_region(const Memory_region&) = delete;
+
+  /** Non copy-assignable. */
+  Memory_region& operator=(const Memory_region&) = delete;
+
+  /** Move-constructible. */
+  Memory_region(Memory_region&& rhs) noexcept
+  {
+    swap(rhs);
+  }
+
+  /** Move-assignable. */
+  Memory_region& operator=(Memory_region&& rhs) noexcept
+  {
+    Memory_region tmp{std::move(rhs)};
+    swap(tmp);
+    return *this;
+  }
+
+  /** Swaps this instance with `other`. */
+  void swap(Memory_region& other) noexcept
+  {
+    using std::swap;
+    swap(data_, other.data_);
+    swap(size_, other.size_);
+    swap(page_kind_, other.page_kind_);
+  }
+
+  /** @returns The region data. */
+  void* data() const noexcept
+  {
+    return data_;
+  }
+
+  /** @returns The region size. */
+  std::size_t size() const noexcept
+  {
+    return size_;
+  }
+
+  /** @returns The kind of pages obtained. */
+  Page_kind page_kind() const noexcept
+  {
+    return page_kind_;
+  }
+
+private:
+  void* data_{};
+  std::size_t size_{};
+  Page_kind page_kind_{Page_kind::regular};
+};
+
+/**
+ * @internal
+ *
+ * @brief The allocator which satisfies the requirements of Allocator (of the
+ * standard library) and places large allocations in memory regions mapped by
+ * `map_pages(n, Kind)`.
+ *
+ * @details Allocations smaller than the `huge_page_size()` cannot benefit from
+ * huge pages and are served by the aligned `operator new`.
+ */
+template<typename T, Page_kind Kind = Page_kind::huge>
+class Huge_page_allocator {
+public:
+  /** The Allocator requirement. */
+  using value_type = T;
+
+  /** The Allocator requirement. */
+  template<typename U>
+  struct rebind final {
+    using other = Huge_page_allocator<U, Kind>;
+  };
+
+  /** The Allocator requirement. */
+  using is_always_equal = std::true_type;
+
+  /** The default constructor. */
+  Huge_page_allocator() noexcept = default;
+
+  /** The converting constructor. */
+  template<typename U>
+  Huge_page_allocator(const Huge_page_allocator<U, Kind>&) noexcept
+  {}
+
+  /** @returns The pointer to the storage for `n` objects of type `T`. */
+  T* allocate(const std::size_t n)
+  {
+    if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+      throw std::bad_array_new_length{};
+    const std::size_t size = n * sizeof(T);
+    if (size < huge_page_size())
+      return static_cast<T*>(::operator new(size, std::align_val_t{alignof(T)}));
+    else
+      return static_cast<T*>(map_pages(size, Kind));
+  }
+
+  /** Deallocates the storage returned by `allocate(n)`. */
+  void deallocate(T* const p, const std::size_t n) noexcept
+  {
+    const std::size_t size = n * sizeof(T);
+    if (size < huge_page_size())
+      ::operator delete(p, std::align_val_t{alignof(T)});
+    else
+      unmap_pages(p, size);
+  }
+
+  /** @returns `true`. */
+  template<typename U>
+  bool operator==(const Huge_page_allocator<U, Kind>&) const noexcept
+  {
+    return true;
+  }
+
+  /** @returns `false`. */
+  template<typename U>
+  bool operator!=(const Huge_page_allocator<U, Kind>&) const noexcept
+  {
+    return false;
+  }
+};
+
 // -----------------------------------------------------------------------------
 
 namespace io {
@@ -51,10 +774,380 @@ enum Origin {
 #endif
 };
 
-DMITIGR_INTERNAL_API std::size_t seek(int fd, long offset, Origin whence);
+/**
+ * @internal
+ *
+ * @brief Sets the file offset of the `fd`.
+ *
+ * @returns The resulting offset from the beginning of the file.
+ */
+DMITIGR_INTERNAL_API std::uint64_t seek(int fd, std::int64_t offset, Origin whence);
 
+/**
+ * @internal
+ *
+ * @brief Reads up to `count` bytes from `fd` into `buffer` by the single call.
+ *
+ * @returns The number of bytes read, or `0` at the end of the file.
+ */
 DMITIGR_INTERNAL_API std::size_t read(int fd, void* buffer, unsigned int count);
 
+/**
+ * @internal
+ *
+ * @brief Writes up to `count` bytes from `buffer` to `fd` by the single call.
+ *
+ * @returns The number of bytes written.
+ */
+DMITIGR_INTERNAL_API std::size_t write(int fd, const void* buffer, unsigned int count);
+
+/**
+ * @internal
+ *
+ * @brief Reads `count` bytes from `fd` into `buffer`, retrying on short reads
+ * and interrupts.
+ *
+ * @returns The number of bytes read, which is less than `count` only if the
+ * end of the file is reached.
+ */
+DMITIGR_INTERNAL_API std::size_t read_fully(int fd, void* buffer, std::size_t count);
+
+/**
+ * @internal
+ *
+ * @brief Writes `count` bytes from `buffer` to `fd`, retrying on short writes
+ * and interrupts.
+ */
+DMITIGR_INTERNAL_API void write_fully(int fd, const void* buffer, std::size_t count);
+
+#ifndef _WIN32
+
+/**
+ * @internal
+ *
+ * @brief Reads up to `count` bytes from `fd` at the given `offset` by the
+ * single call without changing the file offset. Thus, several threads can
+ * read the same file descriptor concurrently.
+ *
+ * @returns The number of bytes read, or `0` at the end of the file.
+ */
+DMITIGR_INTERNAL_API std::size_t pread(int fd, void* buffer, std::size_t count, std::uint64_t offset);
+
+/**
+ * @internal
+ *
+ * @brief Writes up to `count` bytes from `buffer` to `fd` at the given `offset`
+ * by the single call without changing the file offset.
+ *
+ * @returns The number of bytes written.
+ */
+DMITIGR_INTERNAL_API std::size_t pwrite(int fd, const void* buffer, std::size_t count, std::uint64_t offset);
+
+/**
+ * @internal
+ *
+ * @brief Similar to read_fully() but reads at the given `offset` without
+ * changing the file offset.
+ */
+DMITIGR_INTERNAL_API std::size_t pread_fully(int fd, void* buffer, std::size_t count, std::uint64_t offset);
+
+/**
+ * @internal
+ *
+ * @brief Similar to write_fully() but writes at the given `offset` without
+ * changing the file offset.
+ */
+DMITIGR_INTERNAL_API void pwrite_fully(int fd, const void* buffer, std::size_t count, std::uint64_t offset);
+
+/**
+ * @internal
+ *
+ * @brief Reads from `fd` into the `iovcnt` buffers described by `iov` by the
+ * single call.
+ *
+ * @returns The number of bytes read, or `0` at the end of the file.
+ */
+DMITIGR_INTERNAL_API std::size_t readv(int fd, const ::iovec* iov, int iovcnt);
+
+/**
+ * @internal
+ *
+ * @brief Writes the `iovcnt` buffers described by `iov` to `fd` by the single
+ * call.
+ *
+ * @returns The number of bytes written.
+ */
+DMITIGR_INTERNAL_API std::size_t writev(int fd, const ::iovec* iov, int iovcnt);
+
+/**
+ * @internal
+ *
+ * @brief Writes all of the `iovcnt` buffers described by `iov` to `fd`,
+ * retrying on short writes and interrupts.
+ *
+ * @par Effects
+ * The elements of `iov` are modified.
+ */
+DMITIGR_INTERNAL_API void writev_fully(int fd, ::iovec* iov, int iovcnt);
+
+/**
+ * @internal
+ *
+ * @brief Transfers up to `count` bytes from `in_fd` starting at the `offset`
+ * to `out_fd` at its current file offset.
+ *
+ * The data is transferred inside the kernel if possible by using (in the order
+ * of preference) copy_file_range(), sendfile() or splice(). Otherwise, the
+ * data is transferred through the buffer in the user space.
+ *
+ * @returns The number of bytes transferred, which is less than `count` only
+ * if the end of the input is reached.
+ *
+ * @remarks The file offset of `in_fd` is not changed.
+ */
+DMITIGR_INTERNAL_API std::uint64_t transfer(int in_fd, int out_fd, std::uint64_t offset, std::uint64_t count);
+
+/**
+ * @internal
+ *
+ * @brief Represents a region of a file.
+ */
+struct Extent final {
+  /** The offset of the region. */
+  std::uint64_t offset{};
+
+  /** The size of the region. */
+  std::uint64_t size{};
+};
+
+/**
+ * @internal
+ *
+ * @returns The first region of data (i.e. not a hole) of `fd` that starts at
+ * or contains the `offset`, or `std::nullopt` if there is no more data.
+ *
+ * The regions are found by seeking with `seek_data` and `seek_hole` origins.
+ * If the filesystem doesn't support them, the rest of the file is treated as
+ * a single region of data.
+ *
+ * @remarks The file offset of `fd` is changed.
+ */
+DMITIGR_INTERNAL_API std::optional<Extent> next_data_extent(int fd, std::uint64_t offset);
+
+/**
+ * @internal
+ *
+ * @returns The regions of data of `fd`.
+ *
+ * @see next_data_extent().
+ */
+DMITIGR_INTERNAL_API std::vector<Extent> data_extents(int fd);
+
+/**
+ * @internal
+ *
+ * @brief Represents a callback of read_data().
+ *
+ * The callback accepts the offset of the data in the file, the pointer to
+ * the data and the size of the data.
+ */
+using Read_data_callback = std::function<void (std::uint64_t offset, const char* data, std::size_t size)>;
+
+/**
+ * @internal
+ *
+ * @brief Reads the regions of data of `fd` by blocks skipping the holes.
+ *
+ * @param callback - The callback to be called for each block read.
+ * @param block_size - The maximum size of the block.
+ *
+ * @remarks The file offset of `fd` is changed.
+ */
+DMITIGR_INTERNAL_API void read_data(int fd, const Read_data_callback& callback, std::size_t block_size = 256 * 1024);
+
+/**
+ * @internal
+ *
+ * @brief Copies the content of `in_fd` to `out_fd` preserving the holes.
+ *
+ * Only the regions of data are transferred (by transfer()). The holes are
+ * recreated at the destination by seeking over them and by setting the size
+ * of the destination at the end.
+ *
+ * @returns The number of bytes of data transferred.
+ *
+ * @par Requires
+ * `out_fd` refers to a regular file which is empty.
+ *
+ * @remarks The file offsets of both `in_fd` and `out_fd` are changed.
+ */
+DMITIGR_INTERNAL_API std::uint64_t copy_sparse(int in_fd, int out_fd);
+
+/**
+ * @internal
+ *
+ * @brief Represents a request of an asynchronous operation.
+ *
+ * @see Async_io.
+ */
+struct Async_request final {
+  /** Represents a kind of the operation. */
+  enum class Kind { read, write };
+
+  /** The kind of the operation. */
+  Kind kind{Kind::read};
+
+  /** The file descriptor, or the index of the registered file. */
+  int fd{-1};
+
+  /** The indicator that `fd` is the index of the registered file. */
+  bool is_registered_file{};
+
+  /** The buffer to read into or to write from. */
+  void* buffer{};
+
+  /** The number of bytes to transfer. */
+  std::size_t count{};
+
+  /** The offset in the file. */
+  std::uint64_t offset{};
+
+  /**
+   * The index of the registered buffer which contains the range
+   * [buffer, buffer + count), or `-1` if the buffer is not registered.
+   */
+  int buffer_index{-1};
+
+  /** The value which is passed through to the completion. */
+  std::uint64_t user_data{};
+};
+
+/**
+ * @internal
+ *
+ * @brief Represents a completion of an asynchronous operation.
+ */
+struct Async_completion final {
+  /** The value of Async_request::user_data. */
+  std::uint64_t user_data{};
+
+  /** The number of bytes transferred, or the negated `errno` value on error. */
+  std::int64_t result{};
+};
+
+/**
+ * @internal
+ *
+ * @brief Represents an asynchronous I/O engine.
+ *
+ * The requests are accumulated by prepare() and passed to the kernel in batch
+ * by submit(). On Linux, the io_uring interface is used if supported by the
+ * kernel. Otherwise, the requests are performed by a pool of threads with
+ * pread() and pwrite().
+ *
+ * @remarks The object is not thread-safe.
+ */
+class Async_io {
+public:
+  /**
+   * @brief Represents the options of the engine.
+   */
+  struct Options final {
+    /** The maximum number of requests in flight. */
+    unsigned queue_depth{256};
+
+    /** The number of threads of the fallback engine, or `0` to use the default. */
+    std::size_t fallback_thread_count{};
+
+    /** The indicator to use the fallback engine unconditionally. */
+    bool is_fallback_forced{};
+  };
+
+  /** Constructs the engine with the default options. */
+  DMITIGR_INTERNAL_API Async_io();
+
+  /** Constructs the engine. */
+  DMITIGR_INTERNAL_API explicit Async_io(const Options& options);
+
+  /**
+   * @brief The destructor.
+   *
+   * Waits for the completion of the requests in flight.
+   */
+  DMITIGR_INTERNAL_API ~Async_io();
+
+  /** Non copy-constructible. */
+  Async_io(const Async_io&) = delete;
+
+  /** Non copy-assignable. */
+  Async_io& operator=(const Async_io&) = delete;
+
+  /** @returns `true` if the io_uring interface is used. */
+  DMITIGR_INTERNAL_API bool is_io_uring() const noexcept;
+
+  /** @returns The maximum number of requests in flight. */
+  DMITIGR_INTERNAL_API unsigned queue_depth() const noexcept;
+
+  /**
+   * @brief Registers the buffers to be referred by Async_request::buffer_index.
+   *
+   * Registration allows the kernel to avoid mapping the buffers on each request.
+   *
+   * @par Requires
+   * There are no requests in flight.
+   */
+  DMITIGR_INTERNAL_API void register_buffers(const ::iovec* iov, unsigned count);
+
+  /**
+   * @brief Registers the files to be referred by Async_request::fd if
+   * Async_request::is_registered_file is `true`.
+   *
+   * Registration allows the kernel to avoid the lookup of the file descriptors
+   * on each request.
+   *
+   * @par Requires
+   * There are no requests in flight.
+   */
+  DMITIGR_INTERNAL_API void register_files(const int* fds, unsigned count);
+
+  /**
+   * @brief Adds the request to the batch to be submitted.
+   *
+   * If the number of requests in flight reaches the queue depth, then waits
+   * for some completions. (They are returned by the subsequent calls of reap().)
+   */
+  DMITIGR_INTERNAL_API void prepare(const Async_request& request);
+
+  /**
+   * @brief Submits the prepared requests.
+   *
+   * @returns The number of requests submitted.
+   */
+  DMITIGR_INTERNAL_API std::size_t submit();
+
+  /**
+   * @brief Submits the prepared requests and appends the completions to the
+   * `completions`, waiting for at least `min_count` of them.
+   *
+   * @returns The number of completions appended.
+   */
+  DMITIGR_INTERNAL_API std::size_t reap(std::vector<Async_completion>& completions, std::size_t min_count = 1);
+
+  /** @returns The number of requests which are prepared or in flight and not reaped. */
+  DMITIGR_INTERNAL_API std::size_t pending_count() const noexcept;
+
+  /** The engine implementation. (Implementation detail.) */
+  class Engine;
+
+private:
+  std::unique_ptr<Engine> engine_;
+  std::vector<Async_completion> ready_;
+  std::size_t in_flight_count_{};
+  unsigned queue_depth_{};
+};
+
+#endif  // _WIN32
+
 } // namespace io
 
 } // namespace dmitigr::internal::os